@@ -0,0 +1,387 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace NSet {
+    // keys per node: small keys get wide nodes, big keys get narrower ones
+    template <typename ValueType>
+    constexpr size_t bplus_node_keys() {
+        return sizeof(ValueType) <= 8 ? 64 : (sizeof(ValueType) <= 16 ? 32 : 16);
+    }
+
+    // the sorted keys of a B+-tree node, stored inline; the nodes of BPlusSet and SnapshotSet derive from it
+    template <typename ValueType, size_t NodeKeys>
+    struct BPlusNode {
+        static_assert(NodeKeys >= 4, "B+-tree nodes need at least 4 keys");
+
+        typedef ValueType value_type;
+        static constexpr size_t Keys = NodeKeys;
+
+        typename std::aligned_storage<sizeof(ValueType), alignof(ValueType)>::type slots[NodeKeys];
+        size_t keys_number;
+        bool leaf;
+
+        explicit
+        BPlusNode(bool is_leaf);
+
+        BPlusNode(const BPlusNode&) = delete;
+        BPlusNode& operator= (const BPlusNode&) = delete;
+
+        ValueType& key(size_t i);
+        const ValueType& key(size_t i) const;
+
+        template <typename... Args>
+        void emplace_key(size_t i, Args&&... args);
+        void remove_key(size_t i);
+        // moves keys [from, keys_number) to the end of other
+        void move_keys(size_t from, BPlusNode* other);
+        // copies the keys of other to the end, nothing is added if a copy throws
+        void copy_keys(const BPlusNode* other);
+
+        size_t lower_index(const ValueType& x) const;
+        size_t upper_index(const ValueType& x) const;
+
+        ~BPlusNode();
+    };
+
+    // inner node over Base with NodeKeys + 1 sons; a Son holds the son in its node member
+    // and may carry more about it (SnapshotSet keeps the size of the subtree there)
+    template <typename Base, typename Son, size_t NodeKeys>
+    struct BPlusInner : Base {
+        Son sons[NodeKeys + 1];
+
+        BPlusInner();
+
+        // called right after the matching key was added
+        void insert_son(size_t i, const Son& son);
+        // called right after the matching key was removed
+        void remove_son(size_t i);
+    };
+
+    // insert and erase steps shared by the B+-trees; Tree makes BPlusOps<Tree> a friend and gives
+    //   typedefs Node, Leaf, Inner and Son,
+    //   Inner* new_inner(),
+    //   Son son_of(Node*) - the son entry of a node that just changed its size,
+    //   Node* writable(Son&) - the son, made safe to change,
+    //   merge_leaves(Leaf* left, Son& right) and merge_inners(Inner* left, ValueType& separator, Son& right) -
+    //   append right (and for inners the separator before it) to left and get rid of right
+    template <typename Tree>
+    struct BPlusOps {
+        typedef typename Tree::Node Node;
+        typedef typename Tree::Leaf Leaf;
+        typedef typename Tree::Inner Inner;
+        typedef typename Tree::Son Son;
+        typedef typename Node::value_type ValueType;
+
+        static constexpr size_t NodeKeys = Node::Keys;
+        static constexpr size_t MinLeafKeys = NodeKeys / 2;
+        static constexpr size_t MinInnerKeys = (NodeKeys - 1) / 2;
+
+        // splits the full leaf into leaf and the empty split_leaf and puts x at i,
+        // returns where x went; split_leaf starts with the old key(NodeKeys / 2) in any case
+        static std::pair<Leaf*, size_t> split_leaf(Leaf* leaf, Leaf* split_leaf, size_t i, ValueType&& x);
+
+        // pushes up_key and up_son into path[depth - 1], whose son path_index[depth - 1] has just split,
+        // splitting full parents in turn and growing a new root at the top;
+        // returns how many ancestors are above the parent that took them without splitting
+        static size_t push_up(Tree& tree, Inner** path, const size_t* path_index, size_t depth,
+                              ValueType& up_key, Son up_son, Node*& root);
+
+        // restores the fill of the nodes on the path after an erase from leaf, the son of path[depth - 1];
+        // the root may be left an inner node without keys
+        static void rebalance_path(Tree& tree, Leaf* leaf, Inner** path, const size_t* path_index, size_t depth);
+        // the part of rebalance_path above the leaves, path[depth - 1] is the first node checked
+        static void rebalance_inners(Tree& tree, Inner** path, const size_t* path_index, size_t depth);
+
+        // both change nothing if writable or the merge hook throws
+        static void rebalance_leaf(Tree& tree, Leaf* v, Inner* par, size_t index);
+        static void rebalance_inner(Tree& tree, Inner* v, Inner* par, size_t index);
+
+        // the move part of merge_inners for a right node that can be taken apart, right is left empty
+        static void absorb_inner(Inner* left, ValueType& separator, Inner* right);
+    };
+}
+
+template <typename ValueType, size_t NodeKeys>
+constexpr size_t NSet::BPlusNode<ValueType, NodeKeys>::Keys;
+
+template <typename ValueType, size_t NodeKeys>
+NSet::BPlusNode<ValueType, NodeKeys>::BPlusNode(bool is_leaf)
+    : keys_number(0)
+    , leaf(is_leaf) {
+}
+
+template <typename ValueType, size_t NodeKeys>
+ValueType& NSet::BPlusNode<ValueType, NodeKeys>::key(size_t i) {
+    return *reinterpret_cast<ValueType*>(&slots[i]);
+}
+
+template <typename ValueType, size_t NodeKeys>
+const ValueType& NSet::BPlusNode<ValueType, NodeKeys>::key(size_t i) const {
+    return *reinterpret_cast<const ValueType*>(&slots[i]);
+}
+
+template <typename ValueType, size_t NodeKeys>
+template <typename... Args>
+void NSet::BPlusNode<ValueType, NodeKeys>::emplace_key(size_t i, Args&&... args) {
+    ValueType x(std::forward<Args>(args)...);
+    for (size_t j = keys_number; j > i; --j) {
+        new(&slots[j]) ValueType(std::move(key(j - 1)));
+        key(j - 1).~ValueType();
+    }
+    new(&slots[i]) ValueType(std::move(x));
+    ++keys_number;
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusNode<ValueType, NodeKeys>::remove_key(size_t i) {
+    key(i).~ValueType();
+    for (size_t j = i + 1; j != keys_number; ++j) {
+        new(&slots[j - 1]) ValueType(std::move(key(j)));
+        key(j).~ValueType();
+    }
+    --keys_number;
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusNode<ValueType, NodeKeys>::move_keys(size_t from, BPlusNode* other) {
+    for (size_t j = from; j != keys_number; ++j) {
+        new(&other->slots[other->keys_number++]) ValueType(std::move(key(j)));
+        key(j).~ValueType();
+    }
+    keys_number = from;
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusNode<ValueType, NodeKeys>::copy_keys(const BPlusNode* other) {
+    size_t old_number = keys_number;
+    try {
+        for (size_t j = 0; j != other->keys_number; ++j) {
+            new(&slots[keys_number]) ValueType(other->key(j));
+            ++keys_number;
+        }
+    } catch (...) {
+        while (keys_number != old_number) {
+            key(--keys_number).~ValueType();
+        }
+        throw;
+    }
+}
+
+template <typename ValueType, size_t NodeKeys>
+size_t NSet::BPlusNode<ValueType, NodeKeys>::lower_index(const ValueType& x) const {
+    size_t l = 0, r = keys_number;
+    while (l < r) {
+        size_t m = (l + r) / 2;
+        if (key(m) < x) {
+            l = m + 1;
+        } else {
+            r = m;
+        }
+    }
+    return l;
+}
+
+template <typename ValueType, size_t NodeKeys>
+size_t NSet::BPlusNode<ValueType, NodeKeys>::upper_index(const ValueType& x) const {
+    size_t l = 0, r = keys_number;
+    while (l < r) {
+        size_t m = (l + r) / 2;
+        if (x < key(m)) {
+            r = m;
+        } else {
+            l = m + 1;
+        }
+    }
+    return l;
+}
+
+template <typename ValueType, size_t NodeKeys>
+NSet::BPlusNode<ValueType, NodeKeys>::~BPlusNode() {
+    for (size_t i = 0; i != keys_number; ++i) {
+        key(i).~ValueType();
+    }
+}
+
+template <typename Base, typename Son, size_t NodeKeys>
+NSet::BPlusInner<Base, Son, NodeKeys>::BPlusInner()
+    : Base(false) {
+}
+
+template <typename Base, typename Son, size_t NodeKeys>
+void NSet::BPlusInner<Base, Son, NodeKeys>::insert_son(size_t i, const Son& son) {
+    for (size_t j = this->keys_number; j > i; --j) {
+        sons[j] = sons[j - 1];
+    }
+    sons[i] = son;
+}
+
+template <typename Base, typename Son, size_t NodeKeys>
+void NSet::BPlusInner<Base, Son, NodeKeys>::remove_son(size_t i) {
+    for (size_t j = i; j != this->keys_number + 1; ++j) {
+        sons[j] = sons[j + 1];
+    }
+}
+
+template <typename Tree>
+constexpr size_t NSet::BPlusOps<Tree>::NodeKeys;
+
+template <typename Tree>
+constexpr size_t NSet::BPlusOps<Tree>::MinLeafKeys;
+
+template <typename Tree>
+constexpr size_t NSet::BPlusOps<Tree>::MinInnerKeys;
+
+template <typename Tree>
+std::pair<typename NSet::BPlusOps<Tree>::Leaf*, size_t>
+NSet::BPlusOps<Tree>::split_leaf(Leaf* leaf, Leaf* split_leaf, size_t i, ValueType&& x) {
+    size_t half = NodeKeys / 2;
+    leaf->move_keys(half, split_leaf);
+    if (i <= half) {
+        leaf->emplace_key(i, std::move(x));
+        return std::make_pair(leaf, i);
+    }
+    split_leaf->emplace_key(i - half, std::move(x));
+    return std::make_pair(split_leaf, i - half);
+}
+
+template <typename Tree>
+size_t NSet::BPlusOps<Tree>::push_up(Tree& tree, Inner** path, const size_t* path_index, size_t depth,
+                                     ValueType& up_key, Son up_son, Node*& root) {
+    while (depth != 0) {
+        --depth;
+        Inner* par = path[depth];
+        size_t p = path_index[depth];
+        // the son that split kept only its left part
+        par->sons[p] = tree.son_of(par->sons[p].node);
+        if (par->keys_number != NodeKeys) {
+            par->emplace_key(p, std::move(up_key));
+            par->insert_son(p + 1, up_son);
+            return depth;
+        }
+
+        Inner* split_v = tree.new_inner();
+        size_t mid = NodeKeys / 2;
+        ValueType mid_key(std::move(par->key(mid)));
+        par->move_keys(mid + 1, split_v);
+        par->remove_key(mid);
+        for (size_t j = mid + 1; j != NodeKeys + 1; ++j) {
+            split_v->sons[j - mid - 1] = par->sons[j];
+        }
+        if (p <= mid) {
+            par->emplace_key(p, std::move(up_key));
+            par->insert_son(p + 1, up_son);
+        } else {
+            split_v->emplace_key(p - mid - 1, std::move(up_key));
+            split_v->insert_son(p - mid, up_son);
+        }
+        up_key = std::move(mid_key);
+        up_son = tree.son_of(split_v);
+    }
+
+    Inner* new_root = tree.new_inner();
+    new_root->emplace_key(0, std::move(up_key));
+    new_root->sons[0] = tree.son_of(root);
+    new_root->sons[1] = up_son;
+    root = new_root;
+    return 0;
+}
+
+template <typename Tree>
+void NSet::BPlusOps<Tree>::rebalance_path(Tree& tree, Leaf* leaf, Inner** path, const size_t* path_index,
+                                          size_t depth) {
+    if (leaf->keys_number >= MinLeafKeys) {
+        return;
+    }
+    rebalance_leaf(tree, leaf, path[depth - 1], path_index[depth - 1]);
+    rebalance_inners(tree, path, path_index, depth);
+}
+
+template <typename Tree>
+void NSet::BPlusOps<Tree>::rebalance_inners(Tree& tree, Inner** path, const size_t* path_index, size_t depth) {
+    while (--depth != 0) {
+        Inner* inner = path[depth];
+        if (inner->keys_number >= MinInnerKeys) {
+            return;
+        }
+        rebalance_inner(tree, inner, path[depth - 1], path_index[depth - 1]);
+    }
+}
+
+template <typename Tree>
+void NSet::BPlusOps<Tree>::rebalance_leaf(Tree& tree, Leaf* v, Inner* par, size_t index) {
+    if (index != 0 && par->sons[index - 1].node->keys_number > MinLeafKeys) {
+        Leaf* bro = static_cast<Leaf*>(tree.writable(par->sons[index - 1]));
+        v->emplace_key(0, std::move(bro->key(bro->keys_number - 1)));
+        bro->remove_key(bro->keys_number - 1);
+        par->key(index - 1) = v->key(0);
+        par->sons[index - 1] = tree.son_of(bro);
+        par->sons[index] = tree.son_of(v);
+        return;
+    }
+    if (index != par->keys_number && par->sons[index + 1].node->keys_number > MinLeafKeys) {
+        Leaf* bro = static_cast<Leaf*>(tree.writable(par->sons[index + 1]));
+        v->emplace_key(v->keys_number, std::move(bro->key(0)));
+        bro->remove_key(0);
+        par->key(index) = bro->key(0);
+        par->sons[index + 1] = tree.son_of(bro);
+        par->sons[index] = tree.son_of(v);
+        return;
+    }
+
+    // both brothers are minimal, glue with one of them
+    if (index != 0) {
+        --index;
+    }
+    Leaf* left = static_cast<Leaf*>(tree.writable(par->sons[index]));
+    tree.merge_leaves(left, par->sons[index + 1]);
+    par->sons[index] = tree.son_of(left);
+    par->remove_key(index);
+    par->remove_son(index + 1);
+}
+
+template <typename Tree>
+void NSet::BPlusOps<Tree>::rebalance_inner(Tree& tree, Inner* v, Inner* par, size_t index) {
+    if (index != 0 && par->sons[index - 1].node->keys_number > MinInnerKeys) {
+        Inner* bro = static_cast<Inner*>(tree.writable(par->sons[index - 1]));
+        v->emplace_key(0, std::move(par->key(index - 1)));
+        v->insert_son(0, bro->sons[bro->keys_number]);
+        par->key(index - 1) = std::move(bro->key(bro->keys_number - 1));
+        bro->remove_key(bro->keys_number - 1);
+        par->sons[index - 1] = tree.son_of(bro);
+        par->sons[index] = tree.son_of(v);
+        return;
+    }
+    if (index != par->keys_number && par->sons[index + 1].node->keys_number > MinInnerKeys) {
+        Inner* bro = static_cast<Inner*>(tree.writable(par->sons[index + 1]));
+        v->emplace_key(v->keys_number, std::move(par->key(index)));
+        v->sons[v->keys_number] = bro->sons[0];
+        par->key(index) = std::move(bro->key(0));
+        bro->remove_key(0);
+        bro->remove_son(0);
+        par->sons[index + 1] = tree.son_of(bro);
+        par->sons[index] = tree.son_of(v);
+        return;
+    }
+
+    if (index != 0) {
+        --index;
+    }
+    Inner* left = static_cast<Inner*>(tree.writable(par->sons[index]));
+    tree.merge_inners(left, par->key(index), par->sons[index + 1]);
+    par->sons[index] = tree.son_of(left);
+    par->remove_key(index);
+    par->remove_son(index + 1);
+}
+
+template <typename Tree>
+void NSet::BPlusOps<Tree>::absorb_inner(Inner* left, ValueType& separator, Inner* right) {
+    size_t shift = left->keys_number + 1;
+    left->emplace_key(left->keys_number, std::move(separator));
+    for (size_t j = 0; j != right->keys_number + 1; ++j) {
+        left->sons[shift + j] = right->sons[j];
+    }
+    right->move_keys(0, left);
+}
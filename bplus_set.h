@@ -0,0 +1,413 @@
+#pragma once
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <utility>
+
+#include "bplus_node.h"
+
+namespace NSet {
+    // B+-tree with keys stored inline in the nodes and linked leaves,
+    // has the same interface as Set, so one can be swapped for the other
+    template <typename ValueType, size_t NodeKeys = bplus_node_keys<ValueType>()>
+    class BPlusSet {
+    private:
+        friend struct BPlusOps<BPlusSet>;
+        typedef BPlusOps<BPlusSet> tree_ops;
+
+        static constexpr size_t MaxHeight = 64;
+
+        typedef BPlusNode<ValueType, NodeKeys> Node;
+
+        struct Son {
+            Node* node;
+        };
+
+        struct LeafLinks {
+            LeafLinks* prev;
+            LeafLinks* next;
+        };
+
+        struct Leaf : Node, LeafLinks {
+            Leaf();
+        };
+
+        typedef BPlusInner<Node, Son, NodeKeys> Inner;
+
+        Node* root_;
+        LeafLinks head_;
+        size_t size_;
+
+        void link_after(LeafLinks* pos, Leaf* leaf);
+        static void unlink(Leaf* leaf);
+
+        // hooks of BPlusOps
+        Inner* new_inner();
+        static Son son_of(Node* v);
+        static Node* writable(Son& son);
+        void merge_leaves(Leaf* left, Son& right);
+        void merge_inners(Inner* left, ValueType& separator, Son& right);
+
+        void dfs(Node* v);
+
+    public:
+        BPlusSet();
+
+        template <typename InputIterator>
+        BPlusSet(InputIterator begin, InputIterator end);
+        BPlusSet(std::initializer_list<ValueType> init_list);
+        BPlusSet(const BPlusSet& other);
+
+        void swap(BPlusSet& other);
+        BPlusSet& operator= (const BPlusSet& other);
+
+        size_t size() const;
+        bool empty() const;
+
+        void insert(const ValueType& x);
+        void erase(const ValueType& x);
+
+        class iterator {
+        private:
+            friend class BPlusSet;
+
+            const LeafLinks* link;
+            size_t index;
+
+            iterator(const LeafLinks* _link, size_t _index)
+                : link(_link)
+                , index(_index) {
+            }
+
+        public:
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef ValueType value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const ValueType* pointer;
+            typedef const ValueType& reference;
+
+            iterator()
+                : link(nullptr)
+                , index(0) {
+            }
+
+            const ValueType& operator* () const {
+                return static_cast<const Leaf*>(link)->key(index);
+            }
+
+            const ValueType* operator-> () const {
+                return &**this;
+            }
+
+            iterator& operator++ () {
+                if (++index == static_cast<const Leaf*>(link)->keys_number) {
+                    link = link->next;
+                    index = 0;
+                }
+                return *this;
+            }
+
+            iterator operator++ (int) {
+                iterator tmp(*this);
+                ++*this;
+                return tmp;
+            }
+
+            iterator& operator-- () {
+                if (index == 0) {
+                    link = link->prev;
+                    index = static_cast<const Leaf*>(link)->keys_number;
+                }
+                --index;
+                return *this;
+            }
+
+            iterator operator-- (int) {
+                iterator tmp(*this);
+                --*this;
+                return tmp;
+            }
+
+            bool operator== (const iterator& other) const {
+                return link == other.link && index == other.index;
+            }
+
+            bool operator!= (const iterator& other) const {
+                return !(*this == other);
+            }
+        };
+
+        iterator begin() const;
+        iterator end() const;
+
+        iterator find(const ValueType& key) const;
+
+        iterator lower_bound(const ValueType& key) const;
+
+        ~BPlusSet();
+    };
+}
+
+template <typename ValueType, size_t NodeKeys>
+NSet::BPlusSet<ValueType, NodeKeys>::Leaf::Leaf()
+    : Node(true) {
+    this->prev = this->next = nullptr;
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusSet<ValueType, NodeKeys>::link_after(LeafLinks* pos, Leaf* leaf) {
+    leaf->prev = pos;
+    leaf->next = pos->next;
+    pos->next->prev = leaf;
+    pos->next = leaf;
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusSet<ValueType, NodeKeys>::unlink(Leaf* leaf) {
+    leaf->prev->next = leaf->next;
+    leaf->next->prev = leaf->prev;
+}
+
+template <typename ValueType, size_t NodeKeys>
+typename NSet::BPlusSet<ValueType, NodeKeys>::Inner* NSet::BPlusSet<ValueType, NodeKeys>::new_inner() {
+    return new Inner();
+}
+
+template <typename ValueType, size_t NodeKeys>
+typename NSet::BPlusSet<ValueType, NodeKeys>::Son NSet::BPlusSet<ValueType, NodeKeys>::son_of(Node* v) {
+    return Son{v};
+}
+
+template <typename ValueType, size_t NodeKeys>
+typename NSet::BPlusSet<ValueType, NodeKeys>::Node* NSet::BPlusSet<ValueType, NodeKeys>::writable(Son& son) {
+    return son.node;
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusSet<ValueType, NodeKeys>::merge_leaves(Leaf* left, Son& right) {
+    Leaf* leaf = static_cast<Leaf*>(right.node);
+    leaf->move_keys(0, left);
+    unlink(leaf);
+    delete leaf;
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusSet<ValueType, NodeKeys>::merge_inners(Inner* left, ValueType& separator, Son& right) {
+    Inner* inner = static_cast<Inner*>(right.node);
+    tree_ops::absorb_inner(left, separator, inner);
+    delete inner;
+}
+
+template <typename ValueType, size_t NodeKeys>
+NSet::BPlusSet<ValueType, NodeKeys>::BPlusSet()
+    : root_(nullptr)
+    , size_(0) {
+    head_.prev = head_.next = &head_;
+}
+
+template <typename ValueType, size_t NodeKeys>
+template <typename InputIterator>
+NSet::BPlusSet<ValueType, NodeKeys>::BPlusSet(InputIterator begin, InputIterator end)
+    : BPlusSet() {
+    // the delegated constructor is done, so the destructor cleans up if an insert throws
+    while (begin != end) {
+        insert(*(begin++));
+    }
+}
+
+template <typename ValueType, size_t NodeKeys>
+NSet::BPlusSet<ValueType, NodeKeys>::BPlusSet(std::initializer_list<ValueType> init_list)
+    : BPlusSet(init_list.begin(), init_list.end()) {
+}
+
+template <typename ValueType, size_t NodeKeys>
+NSet::BPlusSet<ValueType, NodeKeys>::BPlusSet(const BPlusSet& other)
+    : BPlusSet(other.begin(), other.end()) {
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusSet<ValueType, NodeKeys>::dfs(Node* v) {
+    if (v->leaf) {
+        delete static_cast<Leaf*>(v);
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(v);
+    for (size_t i = 0; i != inner->keys_number + 1; ++i) {
+        dfs(inner->sons[i].node);
+    }
+    delete inner;
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusSet<ValueType, NodeKeys>::swap(BPlusSet& other) {
+    std::swap(root_, other.root_);
+    std::swap(size_, other.size_);
+    std::swap(head_, other.head_);
+    // the outer leaves still point at the old sentinels
+    for (BPlusSet* s : {this, &other}) {
+        if (s->root_ == nullptr) {
+            s->head_.prev = s->head_.next = &s->head_;
+        } else {
+            s->head_.next->prev = s->head_.prev->next = &s->head_;
+        }
+    }
+}
+
+template <typename ValueType, size_t NodeKeys>
+NSet::BPlusSet<ValueType, NodeKeys>& NSet::BPlusSet<ValueType, NodeKeys>::operator= (const BPlusSet& other) {
+    BPlusSet<ValueType, NodeKeys> tmp(other);
+    swap(tmp);
+    return *this;
+}
+
+template <typename ValueType, size_t NodeKeys>
+size_t NSet::BPlusSet<ValueType, NodeKeys>::size() const {
+    return size_;
+}
+
+template <typename ValueType, size_t NodeKeys>
+bool NSet::BPlusSet<ValueType, NodeKeys>::empty() const {
+    return size_ == 0;
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusSet<ValueType, NodeKeys>::insert(const ValueType& key) {
+    if (root_ == nullptr) {
+        Leaf* leaf = new Leaf();
+        try {
+            leaf->emplace_key(0, key);
+        } catch (...) {
+            delete leaf;
+            throw;
+        }
+        link_after(&head_, leaf);
+        root_ = leaf;
+        ++size_;
+        return;
+    }
+
+    Inner* path[MaxHeight];
+    size_t path_index[MaxHeight];
+    size_t depth = 0;
+    Node* v = root_;
+    while (!v->leaf) {
+        Inner* inner = static_cast<Inner*>(v);
+        path[depth] = inner;
+        path_index[depth] = inner->upper_index(key);
+        v = inner->sons[path_index[depth]].node;
+        ++depth;
+    }
+
+    Leaf* leaf = static_cast<Leaf*>(v);
+    size_t i = leaf->lower_index(key);
+    if (i != leaf->keys_number && !(key < leaf->key(i))) {
+        return;
+    }
+    if (leaf->keys_number != NodeKeys) {
+        leaf->emplace_key(i, key);
+        ++size_;
+        return;
+    }
+
+    // the copies that may throw are made before the leaf is split
+    ValueType x(key);
+    ValueType up_key(leaf->key(NodeKeys / 2));
+    Leaf* split_leaf = new Leaf();
+    tree_ops::split_leaf(leaf, split_leaf, i, std::move(x));
+    link_after(leaf, split_leaf);
+    ++size_;
+    tree_ops::push_up(*this, path, path_index, depth, up_key, son_of(split_leaf), root_);
+}
+
+template <typename ValueType, size_t NodeKeys>
+void NSet::BPlusSet<ValueType, NodeKeys>::erase(const ValueType& key) {
+    if (root_ == nullptr) {
+        return;
+    }
+
+    Inner* path[MaxHeight];
+    size_t path_index[MaxHeight];
+    size_t depth = 0;
+    Node* v = root_;
+    while (!v->leaf) {
+        Inner* inner = static_cast<Inner*>(v);
+        path[depth] = inner;
+        path_index[depth] = inner->upper_index(key);
+        v = inner->sons[path_index[depth]].node;
+        ++depth;
+    }
+
+    Leaf* leaf = static_cast<Leaf*>(v);
+    size_t i = leaf->lower_index(key);
+    if (i == leaf->keys_number || key < leaf->key(i)) {
+        return;
+    }
+    --size_;
+    leaf->remove_key(i);
+
+    if (depth == 0) {
+        if (leaf->keys_number == 0) {
+            unlink(leaf);
+            delete leaf;
+            root_ = nullptr;
+        }
+        return;
+    }
+
+    tree_ops::rebalance_path(*this, leaf, path, path_index, depth);
+    Inner* top = static_cast<Inner*>(root_);
+    if (top->keys_number == 0) {
+        root_ = top->sons[0].node;
+        delete top;
+    }
+}
+
+template <typename ValueType, size_t NodeKeys>
+typename NSet::BPlusSet<ValueType, NodeKeys>::iterator
+NSet::BPlusSet<ValueType, NodeKeys>::begin() const {
+    return iterator(head_.next, 0);
+}
+
+template <typename ValueType, size_t NodeKeys>
+typename NSet::BPlusSet<ValueType, NodeKeys>::iterator
+NSet::BPlusSet<ValueType, NodeKeys>::end() const {
+    return iterator(&head_, 0);
+}
+
+template <typename ValueType, size_t NodeKeys>
+typename NSet::BPlusSet<ValueType, NodeKeys>::iterator
+NSet::BPlusSet<ValueType, NodeKeys>::find(const ValueType& key) const {
+    iterator it = lower_bound(key);
+    if (it != end() && !(key < *it)) {
+        return it;
+    }
+    return end();
+}
+
+template <typename ValueType, size_t NodeKeys>
+typename NSet::BPlusSet<ValueType, NodeKeys>::iterator
+NSet::BPlusSet<ValueType, NodeKeys>::lower_bound(const ValueType& key) const {
+    if (root_ == nullptr) {
+        return end();
+    }
+    const Node* v = root_;
+    while (!v->leaf) {
+        const Inner* inner = static_cast<const Inner*>(v);
+        v = inner->sons[inner->upper_index(key)].node;
+    }
+    const Leaf* leaf = static_cast<const Leaf*>(v);
+    size_t i = leaf->lower_index(key);
+    if (i == leaf->keys_number) {
+        return iterator(leaf->next, 0);
+    }
+    return iterator(leaf, i);
+}
+
+template <typename ValueType, size_t NodeKeys>
+NSet::BPlusSet<ValueType, NodeKeys>::~BPlusSet() {
+    if (root_ != nullptr) {
+        dfs(root_);
+    }
+    root_ = nullptr;
+    size_ = 0;
+}
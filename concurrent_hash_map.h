@@ -0,0 +1,210 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+#include "hash_map.h"
+
+namespace HashMap {
+    // HashMap for many threads: the elements are spread over shards by their hash,
+    // every shard is a HashMap under its own lock and grows or shrinks on its own
+    template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class Policy = DefaultPolicy>
+    class ConcurrentHashMap {
+    private:
+        typedef HashMap<KeyType, ValueType, Hash, Policy> shard_map;
+
+        // padded by a cache line, so locking one shard doesn't slow down its neighbours;
+        // alignas(64) isn't honoured by container allocations before C++17
+        struct Shard {
+            mutable std::mutex mutex;
+            shard_map map;
+            char padding[64];
+
+            explicit Shard(const Hash &_hasher)
+                    : map(_hasher) {}
+        };
+
+        Hash hasher;
+        // a deque builds the shards in place, they can't be moved
+        std::deque<Shard> shards;
+
+        Shard &shard_of(const KeyType &key) {
+            return shards[shard_index(hasher(key), shards.size())];
+        }
+
+        const Shard &shard_of(const KeyType &key) const {
+            return shards[shard_index(hasher(key), shards.size())];
+        }
+
+        static size_t round_up(size_t shards_number) {
+            size_t count = 1;
+            while (count < shards_number)
+                count *= 2;
+            return count;
+        }
+
+    public:
+        static constexpr size_t DefaultShards = 64;
+
+        // the number of shards is rounded up to a power of two
+        explicit
+        ConcurrentHashMap(size_t shards_number = DefaultShards, const Hash &_hasher = Hash())
+                : hasher(_hasher) {
+            for (size_t count = round_up(shards_number); count != 0; --count)
+                shards.emplace_back(_hasher);
+        }
+
+        ConcurrentHashMap(const ConcurrentHashMap &) = delete;
+
+        ConcurrentHashMap &operator=(const ConcurrentHashMap &) = delete;
+
+        // locks every shard in turn, the sum is only exact if nobody writes meanwhile
+        size_t size() const;
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        Hash hash_function() const {
+            return hasher;
+        }
+
+        size_t shards_number() const {
+            return shards.size();
+        }
+
+        // true if the element is new
+        bool insert(const std::pair<KeyType, ValueType> &);
+
+        bool insert(std::pair<KeyType, ValueType> &&);
+
+        // true if key was there
+        bool erase(const KeyType &);
+
+        void clear();
+
+        bool contains(const KeyType &) const;
+
+        // copies the value of key into value, false if key is not there
+        bool find(const KeyType &, ValueType &value) const;
+
+        // inserts or overwrites, true if the element is new
+        template<class M>
+        bool upsert(const KeyType &, M &&);
+
+        // calls f(value) under the shard lock, value is default-constructed if key is not there
+        template<class F>
+        void compute(const KeyType &, F f);
+
+        // calls f(value) under the shard lock if key is there
+        template<class F>
+        bool compute_if_present(const KeyType &, F f);
+
+        // calls f(key, value) for every element, one shard locked at a time
+        template<class F>
+        void for_each(F f) const;
+    };
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    constexpr size_t ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::DefaultShards;
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    size_t ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::size() const {
+        size_t total = 0;
+        for (const auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.map.size();
+        }
+        return total;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    bool ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::insert(
+            const std::pair<KeyType, ValueType> &element) {
+        auto &shard = shard_of(element.first);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.map.try_emplace(element.first, element.second).second;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    bool ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::insert(
+            std::pair<KeyType, ValueType> &&element) {
+        auto &shard = shard_of(element.first);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.map.try_emplace(std::move(element.first), std::move(element.second)).second;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    bool ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::erase(const KeyType &key) {
+        auto &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size_t before = shard.map.size();
+        shard.map.erase(key);
+        return shard.map.size() != before;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    void ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::clear() {
+        for (auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.map.clear();
+        }
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    bool ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::contains(const KeyType &key) const {
+        auto &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.map.find(key) != shard.map.end();
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    bool ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::find(const KeyType &key, ValueType &value) const {
+        auto &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end())
+            return false;
+        value = it->second;
+        return true;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    template<class M>
+    bool ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::upsert(const KeyType &key, M &&obj) {
+        auto &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.map.insert_or_assign(key, std::forward<M>(obj)).second;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    template<class F>
+    void ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::compute(const KeyType &key, F f) {
+        auto &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        f(shard.map[key]);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    template<class F>
+    bool ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::compute_if_present(const KeyType &key, F f) {
+        auto &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end())
+            return false;
+        f(it->second);
+        return true;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    template<class F>
+    void ConcurrentHashMap<KeyType, ValueType, Hash, Policy>::for_each(F f) const {
+        for (const auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (const auto &element : shard.map)
+                f(element.first, element.second);
+        }
+    }
+}
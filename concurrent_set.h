@@ -0,0 +1,273 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "set.h"
+
+namespace NSet {
+    // Set shared between threads for read-mostly work (the Left-Right scheme):
+    // there are two copies of the set, readers never lock and never wait,
+    // a writer changes the copy nobody reads, moves readers over to it,
+    // waits for the readers of the old copy to leave and repeats the change there
+    template <typename ValueType, typename Allocator = std::allocator<ValueType>>
+    class ConcurrentSet {
+    public:
+        typedef Set<ValueType, Allocator> set_type;
+
+    private:
+        static constexpr size_t Stripes = 64;
+
+        struct alignas(64) Counter {
+            std::atomic<long> readers;
+
+            Counter()
+                : readers(0) {
+            }
+        };
+
+        // counts readers inside, spread over cache lines so they don't fight
+        class ReadIndicator {
+        private:
+            Counter counters_[Stripes];
+
+        public:
+            void arrive(size_t stripe) {
+                counters_[stripe].readers.fetch_add(1);
+            }
+
+            void depart(size_t stripe) {
+                counters_[stripe].readers.fetch_sub(1);
+            }
+
+            bool empty() const {
+                for (const Counter& counter : counters_) {
+                    if (counter.readers.load() != 0) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+        };
+
+        class ReadGuard {
+        private:
+            ReadIndicator& indicator_;
+            size_t stripe_;
+
+        public:
+            ReadGuard(ReadIndicator& indicator, size_t stripe)
+                : indicator_(indicator)
+                , stripe_(stripe) {
+                indicator_.arrive(stripe_);
+            }
+
+            ReadGuard(const ReadGuard&) = delete;
+            ReadGuard& operator= (const ReadGuard&) = delete;
+
+            ~ReadGuard() {
+                indicator_.depart(stripe_);
+            }
+        };
+
+        set_type sets_[2];
+        // the copy readers go to
+        std::atomic<int> read_index_;
+        // the indicator new readers arrive at
+        std::atomic<int> version_index_;
+        mutable ReadIndicator indicators_[2];
+        std::mutex writer_;
+        // f threw on the copy readers don't use, it is rebuilt from the other one before the next write
+        bool stale_;
+
+        static size_t stripe();
+        void wait_for_readers(int version);
+        // copies the read copy over the other one, nothing changes if the copy throws
+        void repair(int read_index);
+
+        // f is applied to both copies and has to do the same thing every time;
+        // if it throws the first time nothing changes, if it throws the second time
+        // the change stays, either way the copy it broke is never read
+        template <typename F>
+        void write(F f);
+
+    public:
+        explicit ConcurrentSet(const Allocator& alloc = Allocator());
+
+        template <typename InputIterator>
+        ConcurrentSet(InputIterator begin, InputIterator end, const Allocator& alloc = Allocator());
+        ConcurrentSet(std::initializer_list<ValueType> init_list, const Allocator& alloc = Allocator());
+
+        ConcurrentSet(const ConcurrentSet&) = delete;
+        ConcurrentSet& operator= (const ConcurrentSet&) = delete;
+
+        // runs f(const set_type&) as a reader, nothing from the set may outlive the call
+        template <typename F>
+        auto read(F f) const -> decltype(f(std::declval<const set_type&>()));
+
+        size_t size() const;
+        bool contains(const ValueType& key) const;
+        // copies the first element not less than key into result
+        bool lower_bound(const ValueType& key, ValueType& result) const;
+
+        void insert(const ValueType& x);
+        void erase(const ValueType& x);
+        template <typename InputIterator>
+        void insert_batch(InputIterator begin, InputIterator end);
+        template <typename InputIterator>
+        void erase_batch(InputIterator begin, InputIterator end);
+        // f(set_type&) runs twice, once per copy, and has to do the same thing both times
+        template <typename F>
+        void update(F f);
+    };
+}
+
+template <typename ValueType, typename Allocator>
+NSet::ConcurrentSet<ValueType, Allocator>::ConcurrentSet(const Allocator& alloc)
+    : sets_{set_type(alloc), set_type(alloc)}
+    , read_index_(0)
+    , version_index_(0)
+    , stale_(false) {
+}
+
+template <typename ValueType, typename Allocator>
+template <typename InputIterator>
+NSet::ConcurrentSet<ValueType, Allocator>::ConcurrentSet(InputIterator begin, InputIterator end, const Allocator& alloc)
+    : ConcurrentSet(alloc) {
+    sets_[0] = set_type(begin, end, alloc);
+    sets_[1] = sets_[0];
+}
+
+template <typename ValueType, typename Allocator>
+NSet::ConcurrentSet<ValueType, Allocator>::ConcurrentSet(std::initializer_list<ValueType> init_list,
+                                                         const Allocator& alloc)
+    : ConcurrentSet(init_list.begin(), init_list.end(), alloc) {
+}
+
+template <typename ValueType, typename Allocator>
+size_t NSet::ConcurrentSet<ValueType, Allocator>::stripe() {
+    static thread_local size_t index = std::hash<std::thread::id>()(std::this_thread::get_id()) % Stripes;
+    return index;
+}
+
+template <typename ValueType, typename Allocator>
+template <typename F>
+auto NSet::ConcurrentSet<ValueType, Allocator>::read(F f) const
+        -> decltype(f(std::declval<const set_type&>())) {
+    ReadGuard guard(indicators_[version_index_.load()], stripe());
+    return f(sets_[read_index_.load()]);
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::ConcurrentSet<ValueType, Allocator>::wait_for_readers(int version) {
+    while (!indicators_[version].empty()) {
+        std::this_thread::yield();
+    }
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::ConcurrentSet<ValueType, Allocator>::repair(int read_index) {
+    set_type copy(sets_[read_index]);
+    sets_[1 - read_index].swap(copy);
+    stale_ = false;
+}
+
+template <typename ValueType, typename Allocator>
+template <typename F>
+void NSet::ConcurrentSet<ValueType, Allocator>::write(F f) {
+    std::lock_guard<std::mutex> lock(writer_);
+    int read_index = read_index_.load();
+    // the O(n) copy is paid only after a failed write, and never inside a catch
+    if (stale_) {
+        repair(read_index);
+    }
+    try {
+        f(sets_[1 - read_index]);
+    } catch (...) {
+        stale_ = true;
+        throw;
+    }
+    read_index_.store(1 - read_index);
+
+    // readers that could have seen the old copy are gone after both indicators drain
+    int version = version_index_.load();
+    wait_for_readers(1 - version);
+    version_index_.store(1 - version);
+    wait_for_readers(version);
+
+    try {
+        f(sets_[read_index]);
+    } catch (...) {
+        // sets_[read_index] is the copy readers don't use now
+        stale_ = true;
+        throw;
+    }
+}
+
+template <typename ValueType, typename Allocator>
+size_t NSet::ConcurrentSet<ValueType, Allocator>::size() const {
+    return read([](const set_type& s) {
+        return s.size();
+    });
+}
+
+template <typename ValueType, typename Allocator>
+bool NSet::ConcurrentSet<ValueType, Allocator>::contains(const ValueType& key) const {
+    return read([&key](const set_type& s) {
+        return s.find(key) != s.end();
+    });
+}
+
+template <typename ValueType, typename Allocator>
+bool NSet::ConcurrentSet<ValueType, Allocator>::lower_bound(const ValueType& key, ValueType& result) const {
+    return read([&key, &result](const set_type& s) {
+        typename set_type::iterator it = s.lower_bound(key);
+        if (it == s.end()) {
+            return false;
+        }
+        result = *it;
+        return true;
+    });
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::ConcurrentSet<ValueType, Allocator>::insert(const ValueType& x) {
+    write([&x](set_type& s) {
+        s.insert(x);
+    });
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::ConcurrentSet<ValueType, Allocator>::erase(const ValueType& x) {
+    write([&x](set_type& s) {
+        s.erase(x);
+    });
+}
+
+template <typename ValueType, typename Allocator>
+template <typename InputIterator>
+void NSet::ConcurrentSet<ValueType, Allocator>::insert_batch(InputIterator begin, InputIterator end) {
+    std::vector<ValueType> batch(begin, end);
+    write([&batch](set_type& s) {
+        s.insert_batch(batch.begin(), batch.end());
+    });
+}
+
+template <typename ValueType, typename Allocator>
+template <typename InputIterator>
+void NSet::ConcurrentSet<ValueType, Allocator>::erase_batch(InputIterator begin, InputIterator end) {
+    std::vector<ValueType> batch(begin, end);
+    write([&batch](set_type& s) {
+        s.erase_batch(batch.begin(), batch.end());
+    });
+}
+
+template <typename ValueType, typename Allocator>
+template <typename F>
+void NSet::ConcurrentSet<ValueType, Allocator>::update(F f) {
+    write(f);
+}
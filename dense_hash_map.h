@@ -0,0 +1,406 @@
+#pragma once
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "hash_map.h"
+
+namespace HashMap {
+    // chained hash map whose elements live in one dense array in insertion order,
+    // a bucket holds the index of the first element of its chain and every element the index of the next one;
+    // iteration, clear and rebuilds cost O(elements) and walk memory contiguously.
+    // erase leaves a tombstone, so the order is kept; once half of the array is tombstones
+    // the live elements are shifted down over them, which invalidates iterators like inserts do.
+    // An erased element is destroyed only then
+    template<class KeyType, class ValueType, class Hash = std::hash<KeyType>>
+    class DenseHashMap {
+    private:
+        typedef std::pair<KeyType, ValueType> element_type;
+
+        // ends a chain
+        static constexpr size_t None = static_cast<size_t>(-1);
+        // the next of an erased element, it is in no chain
+        static constexpr size_t Dead = None - 1;
+
+        struct Link {
+            size_t hash;
+            size_t next;
+        };
+
+        Hash hasher;
+        std::vector<element_type> elements;
+        // links[i] belongs to elements[i]
+        std::vector<Link> links;
+        std::vector<size_t> buckets;
+        size_t tombstones;
+
+        size_t &head(size_t hash) {
+            return buckets[bucket_index(hash, buckets.size())];
+        }
+
+        // index of the element with key or size()
+        size_t find_index(const KeyType &, size_t hash) const;
+
+        // puts the element at index in front of its chain
+        void link(size_t index);
+
+        // takes the element at index out of its chain
+        void unlink(size_t index);
+
+        // relinks every live element into the given amount of buckets (a power of two),
+        // keeps 1 / 8 <= elements / buckets <= 1 / 2 like HashMap
+        void rebuild(size_t);
+
+        // drops the tombstones, the live elements keep their order,
+        // and relinks them into the given amount of buckets
+        void compact(size_t);
+
+        template<class K, typename... Args>
+        std::pair<size_t, bool> emplace_key(K &&, Args &&...);
+
+    public:
+        explicit
+        DenseHashMap(const Hash &_hasher = Hash())
+                : hasher(_hasher), buckets(MinBuckAmount, None), tombstones(0) {
+        }
+
+        template<typename InputIterator>
+        DenseHashMap(InputIterator begin,
+                     InputIterator end,
+                     const Hash &_hasher = Hash())
+                : DenseHashMap(_hasher) {
+            while (begin != end)
+                insert(*(begin++));
+        }
+
+        DenseHashMap(std::initializer_list<std::pair<KeyType, ValueType>> init_list,
+                     const Hash &_hasher = Hash())
+                : DenseHashMap(init_list.begin(), init_list.end(), _hasher) {}
+
+        DenseHashMap(const DenseHashMap &) = default;
+
+        // other is left empty with MinBuckAmount buckets, the lookups need at least one
+        DenseHashMap(DenseHashMap &&);
+
+        DenseHashMap &operator=(const DenseHashMap &) = default;
+
+        DenseHashMap &operator=(DenseHashMap &&);
+
+        void swap(DenseHashMap &);
+
+        size_t size() const {
+            return elements.size() - tombstones;
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        Hash hash_function() const {
+            return hasher;
+        }
+
+        void insert(std::pair<KeyType, ValueType> &&);
+
+        void insert(const std::pair<KeyType, ValueType> &);
+
+        void erase(const KeyType &);
+
+        ValueType &operator[](const KeyType &);
+
+        ValueType &operator[](KeyType &&);
+
+        void clear();
+
+    private:
+        template <bool is_const>
+        class base_iterator {
+            private:
+                typedef typename std::conditional<is_const, const DenseHashMap*, DenseHashMap*>::type HashMapPtr;
+                typedef typename std::conditional<is_const,
+                        const std::pair<const KeyType, ValueType>, std::pair<const KeyType, ValueType>>::type PairType;
+                HashMapPtr ptr;
+                std::size_t index;
+
+                base_iterator& find_next() {
+                    while (index != ptr->elements.size() && ptr->links[index].next == Dead)
+                        ++index;
+                    return *this;
+                }
+            public:
+                base_iterator()
+                        : ptr(nullptr), index(0) {}
+
+                base_iterator(HashMapPtr _ptr, std::size_t _index)
+                : ptr(_ptr), index(_index) {
+                    find_next();
+                }
+
+                bool operator==(const base_iterator &other) const {
+                    return ptr == other.ptr
+                           && index == other.index;
+                }
+
+                bool operator!=(const base_iterator &other) const {
+                    return !(*this == other);
+                }
+
+                base_iterator& operator++() {
+                    ++index;
+                    return find_next();
+                }
+
+                base_iterator operator++(int) {
+                    base_iterator tmp(*this);
+                    ++(*this);
+                    return tmp;
+                }
+
+                PairType& operator*() const {
+                    auto& ret = reinterpret_cast<PairType&>(ptr->elements[index]);
+                    return ret;
+                }
+
+                PairType*
+                operator->() const {
+                    auto* ret = reinterpret_cast<PairType*>(&ptr->elements[index]);
+                    return ret;
+                }
+        };
+
+    public:
+        typedef base_iterator<false> iterator;
+        typedef base_iterator<true> const_iterator;
+
+        iterator begin() {
+            return iterator(this, 0);
+        }
+
+        const_iterator begin() const {
+            return const_iterator(this, 0);
+        }
+
+        iterator end() {
+            return iterator(this, elements.size());
+        }
+
+        const_iterator end() const {
+            return const_iterator(this, elements.size());
+        }
+
+        iterator find(const KeyType &);
+
+        const_iterator find(const KeyType &) const;
+
+        const ValueType &at(const KeyType &) const;
+
+        // the bool is true if the element is new
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const KeyType &, Args &&...);
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(KeyType &&, Args &&...);
+    };
+
+    template<class KeyType, class ValueType, class Hash>
+    constexpr size_t DenseHashMap<KeyType, ValueType, Hash>::None;
+
+    template<class KeyType, class ValueType, class Hash>
+    constexpr size_t DenseHashMap<KeyType, ValueType, Hash>::Dead;
+
+    template<class KeyType, class ValueType, class Hash>
+    DenseHashMap<KeyType, ValueType, Hash>::DenseHashMap(DenseHashMap &&other)
+            : DenseHashMap(other.hasher) {
+        swap(other);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    DenseHashMap<KeyType, ValueType, Hash> &DenseHashMap<KeyType, ValueType, Hash>::operator=(DenseHashMap &&other) {
+        if (this != &other) {
+            DenseHashMap tmp(std::move(other));
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void DenseHashMap<KeyType, ValueType, Hash>::swap(DenseHashMap &other) {
+        std::swap(hasher, other.hasher);
+        elements.swap(other.elements);
+        links.swap(other.links);
+        buckets.swap(other.buckets);
+        std::swap(tombstones, other.tombstones);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    size_t DenseHashMap<KeyType, ValueType, Hash>::find_index(const KeyType &key, size_t hash) const {
+        for (size_t index = buckets[bucket_index(hash, buckets.size())]; index != None; index = links[index].next) {
+            if (links[index].hash == hash && elements[index].first == key)
+                return index;
+        }
+        return elements.size();
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void DenseHashMap<KeyType, ValueType, Hash>::link(size_t index) {
+        size_t &first = head(links[index].hash);
+        links[index].next = first;
+        first = index;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void DenseHashMap<KeyType, ValueType, Hash>::unlink(size_t index) {
+        size_t *place = &head(links[index].hash);
+        while (*place != index)
+            place = &links[*place].next;
+        *place = links[index].next;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void DenseHashMap<KeyType, ValueType, Hash>::rebuild(size_t buckets_number) {
+        // the hashes are kept, so the hasher is not called
+        std::vector<size_t>(buckets_number, None).swap(buckets);
+        for (size_t index = elements.size(); index-- != 0;) {
+            if (links[index].next != Dead)
+                link(index);
+        }
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void DenseHashMap<KeyType, ValueType, Hash>::compact(size_t buckets_number) {
+        size_t kept = 0;
+        for (size_t index = 0; index != elements.size(); ++index) {
+            if (links[index].next == Dead)
+                continue;
+            if (kept != index) {
+                elements[kept] = std::move(elements[index]);
+                links[kept] = links[index];
+            }
+            ++kept;
+        }
+        elements.erase(elements.begin() + kept, elements.end());
+        links.resize(kept);
+        tombstones = 0;
+        rebuild(buckets_number);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    template<class K, typename... Args>
+    std::pair<size_t, bool> DenseHashMap<KeyType, ValueType, Hash>::emplace_key(K &&key, Args &&... args) {
+        size_t hash = hasher(key);
+        size_t index = find_index(key, hash);
+        if (index != elements.size())
+            return {index, false};
+        links.push_back({hash, None});
+        try {
+            elements.emplace_back(std::piecewise_construct,
+                                  std::forward_as_tuple(std::forward<K>(key)),
+                                  std::forward_as_tuple(std::forward<Args>(args)...));
+        } catch (...) {
+            links.pop_back();
+            throw;
+        }
+        link(index);
+        if (2 * size() >= buckets.size())
+            rebuild(2 * buckets.size());
+        return {index, true};
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void DenseHashMap<KeyType, ValueType, Hash>::insert(
+            std::pair<KeyType, ValueType> &&element) {
+        emplace_key(std::move(element.first), std::move(element.second));
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void DenseHashMap<KeyType, ValueType, Hash>::insert(
+            const std::pair<KeyType, ValueType> &element) {
+        emplace_key(element.first, element.second);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void DenseHashMap<KeyType, ValueType, Hash>::erase(const KeyType &key) {
+        size_t index = find_index(key, hasher(key));
+        if (index == elements.size())
+            return;
+        unlink(index);
+        if (index + 1 == elements.size()) {
+            // nothing comes after the last element, so it goes right away
+            elements.pop_back();
+            links.pop_back();
+        } else {
+            links[index].next = Dead;
+            ++tombstones;
+        }
+        size_t buckets_number = buckets.size();
+        if (8 * size() <= buckets_number && buckets_number > MinBuckAmount)
+            // but buckets.size() needs to be at least MinBuckAmount
+            buckets_number = std::max(MinBuckAmount, buckets_number / 2);
+        // amortized O(1): at least as many erases as live elements happen between compactions;
+        // a compaction relinks everything anyway, so it takes the new bucket count along
+        if (tombstones != 0 && 2 * tombstones >= elements.size())
+            compact(buckets_number);
+        else if (buckets_number != buckets.size())
+            rebuild(buckets_number);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    ValueType &DenseHashMap<KeyType, ValueType, Hash>::operator[](
+            const KeyType &key) {
+        return elements[emplace_key(key).first].second;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    ValueType &DenseHashMap<KeyType, ValueType, Hash>::operator[](
+            KeyType &&key) {
+        return elements[emplace_key(std::move(key)).first].second;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void DenseHashMap<KeyType, ValueType, Hash>::clear() {
+        elements.clear();
+        links.clear();
+        tombstones = 0;
+        std::vector<size_t>(MinBuckAmount, None).swap(buckets);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    typename DenseHashMap<KeyType, ValueType, Hash>::iterator
+    DenseHashMap<KeyType, ValueType, Hash>::find(const KeyType &key) {
+        return iterator(this, find_index(key, hasher(key)));
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    typename DenseHashMap<KeyType, ValueType, Hash>::const_iterator
+    DenseHashMap<KeyType, ValueType, Hash>::find(const KeyType &key) const {
+        return const_iterator(this, find_index(key, hasher(key)));
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    const ValueType &
+    DenseHashMap<KeyType, ValueType, Hash>::at(const KeyType &key) const {
+        const_iterator it = find(key);
+        if (it == end())
+            throw std::out_of_range("");
+        return it->second;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    template<typename... Args>
+    std::pair<typename DenseHashMap<KeyType, ValueType, Hash>::iterator, bool>
+    DenseHashMap<KeyType, ValueType, Hash>::try_emplace(const KeyType &key, Args &&... args) {
+        auto place = emplace_key(key, std::forward<Args>(args)...);
+        return {iterator(this, place.first), place.second};
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    template<typename... Args>
+    std::pair<typename DenseHashMap<KeyType, ValueType, Hash>::iterator, bool>
+    DenseHashMap<KeyType, ValueType, Hash>::try_emplace(KeyType &&key, Args &&... args) {
+        auto place = emplace_key(std::move(key), std::forward<Args>(args)...);
+        return {iterator(this, place.first), place.second};
+    }
+}
@@ -0,0 +1,502 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hash_map.h"
+
+namespace HashMap {
+    // open addressing hash map in the SwissTable style: entries are stored inline,
+    // every slot has a control byte (empty, deleted or 7 bits of the hash),
+    // lookups compare a group of 16 control bytes at once and touch entries only on a match
+    template<class KeyType, class ValueType, class Hash = std::hash<KeyType>>
+    class FlatHashMap {
+    private:
+        typedef std::pair<KeyType, ValueType> slot_type;
+
+        enum : int8_t {
+            Empty = -128,
+            Deleted = -2
+        };
+        static constexpr size_t GroupWidth = 16;
+
+        static unsigned trailing_zeros(unsigned mask) {
+#if defined(__GNUC__)
+            return __builtin_ctz(mask);
+#else
+            unsigned zeros = 0;
+            while (!(mask & 1)) {
+                mask >>= 1;
+                ++zeros;
+            }
+            return zeros;
+#endif
+        }
+
+        static unsigned leading_zeros(unsigned mask) {
+            unsigned zeros = 0;
+            for (unsigned bit = 1u << (GroupWidth - 1); bit != 0 && !(mask & bit); bit >>= 1)
+                ++zeros;
+            return zeros;
+        }
+
+        // 16 control bytes, masks have bit i set for the byte i
+        class Group {
+        private:
+#if defined(__SSE2__)
+            __m128i ctrl;
+
+        public:
+            explicit Group(const int8_t *pos)
+                    : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pos))) {}
+#else
+            const int8_t *ctrl;
+
+        public:
+            explicit Group(const int8_t *pos)
+                    : ctrl(pos) {}
+#endif
+
+            unsigned match(int8_t h2) const {
+#if defined(__SSE2__)
+                return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+#else
+                unsigned mask = 0;
+                for (size_t i = 0; i != GroupWidth; ++i)
+                    if (ctrl[i] == h2)
+                        mask |= 1u << i;
+                return mask;
+#endif
+            }
+
+            unsigned mask_empty() const {
+                return match(Empty);
+            }
+
+            // empty and deleted bytes are the negative ones
+            unsigned mask_non_full() const {
+#if defined(__SSE2__)
+                return _mm_movemask_epi8(ctrl);
+#else
+                unsigned mask = 0;
+                for (size_t i = 0; i != GroupWidth; ++i)
+                    if (ctrl[i] < 0)
+                        mask |= 1u << i;
+                return mask;
+#endif
+            }
+        };
+
+        size_t map_size;
+        Hash hasher;
+        // capacity + GroupWidth bytes, the first GroupWidth are cloned at the end
+        // so a group can be read from any slot without wrapping
+        std::vector<int8_t> ctrl;
+        slot_type *slots;
+        size_t capacity;
+        // how many more elements fit before the table has to be rebuilt
+        size_t growth_left;
+
+        // spreads the bits, std::hash of integers is often the identity
+        static size_t mix(size_t hash) {
+            uint64_t h = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+
+        static int8_t h2(size_t hash) {
+            return static_cast<int8_t>(hash & 0x7F);
+        }
+
+        size_t h1(size_t hash) const {
+            return (hash >> 7) & (capacity - 1);
+        }
+
+        static size_t max_load(size_t _capacity) {
+            return _capacity - _capacity / 8;
+        }
+
+        void set_ctrl(size_t index, int8_t value) {
+            ctrl[index] = value;
+            if (index < GroupWidth)
+                ctrl[capacity + index] = value;
+        }
+
+        void allocate(size_t _capacity);
+
+        // first empty or deleted slot on the probe sequence of hash
+        size_t find_non_full(size_t hash) const;
+
+        // index of the slot with key or capacity
+        size_t find_index(const KeyType &, size_t hash) const;
+
+        // rebuilds the table with _capacity slots (a power of two), dropping deleted ones
+        void rebuild(size_t _capacity);
+
+        // slot for key, constructs it from args if key is not there, the bool is true then
+        template<typename... Args>
+        std::pair<size_t, bool> find_or_insert(const KeyType &, Args &&... args);
+
+        void destroy_slots();
+
+    public:
+        explicit
+        FlatHashMap(const Hash &_hasher = Hash())
+                : map_size(0), hasher(_hasher), slots(nullptr), capacity(0), growth_left(0) {
+            allocate(MinBuckAmount);
+        }
+
+        template<typename InputIterator>
+        FlatHashMap(InputIterator begin,
+                    InputIterator end,
+                    const Hash &_hasher = Hash())
+                : FlatHashMap(_hasher) {
+            while (begin != end)
+                insert(*(begin++));
+        }
+
+        FlatHashMap(std::initializer_list<std::pair<KeyType, ValueType>> init_list,
+                    const Hash &_hasher = Hash())
+                : FlatHashMap(init_list.begin(), init_list.end(), _hasher) {}
+
+        FlatHashMap(const FlatHashMap &other);
+
+        FlatHashMap(FlatHashMap &&other) noexcept;
+
+        FlatHashMap &operator=(FlatHashMap other);
+
+        void swap(FlatHashMap &other) noexcept;
+
+        ~FlatHashMap();
+
+        size_t size() const {
+            return map_size;
+        }
+
+        bool empty() const {
+            return map_size == 0;
+        }
+
+        Hash hash_function() const {
+            return hasher;
+        }
+
+        void insert(std::pair<KeyType, ValueType> &&);
+
+        void insert(const std::pair<KeyType, ValueType> &);
+
+        void erase(const KeyType &);
+
+        ValueType &operator[](const KeyType &);
+
+        void clear();
+
+    private:
+        template <bool is_const>
+        class base_iterator {
+            private:
+                typedef typename std::conditional<is_const, const FlatHashMap*, FlatHashMap*>::type HashMapPtr;
+                typedef typename std::conditional<is_const,
+                        const std::pair<const KeyType, ValueType>, std::pair<const KeyType, ValueType>>::type PairType;
+                HashMapPtr ptr;
+                std::size_t index;
+
+                base_iterator& find_next() {
+                    while (index != ptr->capacity && ptr->ctrl[index] < 0)
+                        ++index;
+                    return *this;
+                }
+            public:
+                base_iterator()
+                        : ptr(nullptr), index(0) {}
+
+                base_iterator(HashMapPtr _ptr, std::size_t _index)
+                : ptr(_ptr), index(_index) {
+                    find_next();
+                }
+
+                bool operator==(const base_iterator &other) const {
+                    return ptr == other.ptr
+                           && index == other.index;
+                }
+
+                bool operator!=(const base_iterator &other) const {
+                    return !(*this == other);
+                }
+
+                base_iterator& operator++() {
+                    if (index == ptr->capacity)
+                        return *this;
+                    ++index;
+                    return find_next();
+                }
+
+                base_iterator operator++(int) {
+                    base_iterator tmp(*this);
+                    ++(*this);
+                    return tmp;
+                }
+
+                PairType& operator*() const {
+                    auto& ret = reinterpret_cast<PairType&>(ptr->slots[index]);
+                    return ret;
+                }
+
+                PairType*
+                operator->() const {
+                    auto* ret = reinterpret_cast<PairType*>(ptr->slots + index);
+                    return ret;
+                }
+        };
+
+    public:
+        typedef base_iterator<false> iterator;
+        typedef base_iterator<true> const_iterator;
+
+        iterator begin() {
+            return iterator(this, 0);
+        }
+
+        const_iterator begin() const {
+            return const_iterator(this, 0);
+        }
+
+        iterator end() {
+            return iterator(this, capacity);
+        }
+
+        const_iterator end() const {
+            return const_iterator(this, capacity);
+        }
+
+        iterator find(const KeyType &);
+
+        const_iterator find(const KeyType &) const;
+
+        const ValueType &at(const KeyType &) const;
+    };
+
+    template<class KeyType, class ValueType, class Hash>
+    void FlatHashMap<KeyType, ValueType, Hash>::allocate(size_t _capacity) {
+        std::vector<int8_t> newctrl(_capacity + GroupWidth, Empty);
+        slots = std::allocator<slot_type>().allocate(_capacity);
+        ctrl.swap(newctrl);
+        capacity = _capacity;
+        growth_left = max_load(capacity) - map_size;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    size_t FlatHashMap<KeyType, ValueType, Hash>::find_non_full(size_t hash) const {
+        // groups are visited at triangular offsets, which covers the whole table
+        size_t pos = h1(hash);
+        for (size_t step = GroupWidth;; step += GroupWidth) {
+            unsigned mask = Group(ctrl.data() + pos).mask_non_full();
+            if (mask)
+                return (pos + trailing_zeros(mask)) & (capacity - 1);
+            pos = (pos + step) & (capacity - 1);
+        }
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    size_t FlatHashMap<KeyType, ValueType, Hash>::find_index(const KeyType &key, size_t hash) const {
+        // a moved-from map has no table at all
+        if (capacity == 0)
+            return capacity;
+        size_t pos = h1(hash);
+        for (size_t step = GroupWidth;; step += GroupWidth) {
+            Group group(ctrl.data() + pos);
+            for (unsigned mask = group.match(h2(hash)); mask; mask &= mask - 1) {
+                size_t index = (pos + trailing_zeros(mask)) & (capacity - 1);
+                if (slots[index].first == key)
+                    return index;
+            }
+            // an empty slot ends every probe sequence that went through it
+            if (group.mask_empty())
+                return capacity;
+            pos = (pos + step) & (capacity - 1);
+        }
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void FlatHashMap<KeyType, ValueType, Hash>::rebuild(size_t newcapacity) {
+        std::vector<int8_t> oldctrl;
+        oldctrl.swap(ctrl);
+        slot_type *oldslots = slots;
+        size_t oldcapacity = capacity;
+        try {
+            allocate(newcapacity);
+        } catch (...) {
+            ctrl.swap(oldctrl);
+            slots = oldslots;
+            throw;
+        }
+        for (size_t i = 0; i != oldcapacity; ++i) {
+            if (oldctrl[i] < 0)
+                continue;
+            size_t hash = mix(hasher(oldslots[i].first));
+            size_t index = find_non_full(hash);
+            ::new(static_cast<void *>(slots + index)) slot_type(std::move(oldslots[i]));
+            oldslots[i].~slot_type();
+            set_ctrl(index, h2(hash));
+        }
+        std::allocator<slot_type>().deallocate(oldslots, oldcapacity);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    template<typename... Args>
+    std::pair<size_t, bool> FlatHashMap<KeyType, ValueType, Hash>::find_or_insert(
+            const KeyType &key, Args &&... args) {
+        size_t hash = mix(hasher(key));
+        size_t index = find_index(key, hash);
+        if (index != capacity)
+            return {index, false};
+        if (capacity == 0)
+            allocate(MinBuckAmount);
+        index = find_non_full(hash);
+        if (growth_left == 0 && ctrl[index] != Deleted) {
+            // the table is full of tombstones or of elements
+            if (2 * map_size < max_load(capacity))
+                rebuild(capacity);
+            else
+                rebuild(2 * capacity);
+            index = find_non_full(hash);
+        }
+        ::new(static_cast<void *>(slots + index)) slot_type(std::forward<Args>(args)...);
+        if (ctrl[index] == Empty)
+            --growth_left;
+        set_ctrl(index, h2(hash));
+        ++map_size;
+        return {index, true};
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void FlatHashMap<KeyType, ValueType, Hash>::destroy_slots() {
+        for (size_t i = 0; i != capacity; ++i) {
+            if (ctrl[i] >= 0)
+                slots[i].~slot_type();
+        }
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    FlatHashMap<KeyType, ValueType, Hash>::FlatHashMap(const FlatHashMap &other)
+            : map_size(0), hasher(other.hasher), slots(nullptr), capacity(0), growth_left(0) {
+        allocate(std::max(MinBuckAmount, other.capacity));
+        try {
+            for (const auto &element : other)
+                find_or_insert(element.first, element);
+        } catch (...) {
+            destroy_slots();
+            std::allocator<slot_type>().deallocate(slots, capacity);
+            throw;
+        }
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    FlatHashMap<KeyType, ValueType, Hash>::FlatHashMap(FlatHashMap &&other) noexcept
+            : map_size(0), hasher(other.hasher), slots(nullptr), capacity(0), growth_left(0) {
+        // other is left without a table, the next insert allocates one
+        swap(other);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    FlatHashMap<KeyType, ValueType, Hash> &FlatHashMap<KeyType, ValueType, Hash>::operator=(FlatHashMap other) {
+        swap(other);
+        return *this;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void FlatHashMap<KeyType, ValueType, Hash>::swap(FlatHashMap &other) noexcept {
+        std::swap(map_size, other.map_size);
+        std::swap(hasher, other.hasher);
+        ctrl.swap(other.ctrl);
+        std::swap(slots, other.slots);
+        std::swap(capacity, other.capacity);
+        std::swap(growth_left, other.growth_left);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    FlatHashMap<KeyType, ValueType, Hash>::~FlatHashMap() {
+        if (slots == nullptr)
+            return;
+        destroy_slots();
+        std::allocator<slot_type>().deallocate(slots, capacity);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void FlatHashMap<KeyType, ValueType, Hash>::insert(
+            std::pair<KeyType, ValueType> &&element) {
+        find_or_insert(element.first, std::move(element));
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void FlatHashMap<KeyType, ValueType, Hash>::insert(
+            const std::pair<KeyType, ValueType> &element) {
+        find_or_insert(element.first, element);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void FlatHashMap<KeyType, ValueType, Hash>::erase(const KeyType &key) {
+        size_t index = find_index(key, mix(hasher(key)));
+        if (index == capacity)
+            return;
+        slots[index].~slot_type();
+        --map_size;
+        // the slot may become empty again if no probe ever saw a full group around it
+        size_t before = (index - GroupWidth) & (capacity - 1);
+        unsigned empty_after = Group(ctrl.data() + index).mask_empty();
+        unsigned empty_before = Group(ctrl.data() + before).mask_empty();
+        if (empty_after && empty_before
+            && trailing_zeros(empty_after) + leading_zeros(empty_before) < GroupWidth) {
+            set_ctrl(index, Empty);
+            ++growth_left;
+        } else {
+            set_ctrl(index, Deleted);
+        }
+        if (8 * map_size <= capacity && capacity > MinBuckAmount)
+            // but capacity needs to be at least MinBuckAmount
+            rebuild(std::max(MinBuckAmount, capacity / 2));
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    ValueType &FlatHashMap<KeyType, ValueType, Hash>::operator[](
+            const KeyType &key) {
+        // the value is only built if key is not there
+        size_t index = find_or_insert(key, std::piecewise_construct,
+                                      std::forward_as_tuple(key), std::forward_as_tuple()).first;
+        return slots[index].second;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void FlatHashMap<KeyType, ValueType, Hash>::clear() {
+        FlatHashMap empty_map(hasher);
+        swap(empty_map);
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    typename FlatHashMap<KeyType, ValueType, Hash>::iterator
+    FlatHashMap<KeyType, ValueType, Hash>::find(const KeyType &key) {
+        return iterator(this, find_index(key, mix(hasher(key))));
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    typename FlatHashMap<KeyType, ValueType, Hash>::const_iterator
+    FlatHashMap<KeyType, ValueType, Hash>::find(const KeyType &key) const {
+        return const_iterator(this, find_index(key, mix(hasher(key))));
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    const ValueType &
+    FlatHashMap<KeyType, ValueType, Hash>::at(const KeyType &key) const {
+        const_iterator it = find(key);
+        if (it == end())
+            throw std::out_of_range("");
+        return it->second;
+    }
+}
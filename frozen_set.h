@@ -0,0 +1,281 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "set.h"
+
+namespace NSet {
+    // immutable sorted set in one array, for sets built once and then only queried
+    // keys are stored in Eytzinger (heap) order: the root at 1, the sons of k at 2k and 2k + 1,
+    // searches walk down without branches and prefetch the levels ahead
+    template <typename ValueType>
+    class FrozenSet {
+    private:
+        // keys_[k - 1] holds the node k
+        std::vector<ValueType> keys_;
+
+        // how many nodes of one level fit into a cache line,
+        // the search prefetches that far below the current node
+        static constexpr size_t prefetch_stride(size_t bytes = 64) {
+            return bytes / 2 >= sizeof(ValueType) ? prefetch_stride(bytes / 2) * 2 : 1;
+        }
+
+        static size_t trailing_ones(size_t k);
+        // in-order neighbours of the node k, 0 stands for end
+        static size_t first_index(size_t n);
+        static size_t last_index(size_t n);
+        static size_t next_index(size_t k, size_t n);
+        static size_t prev_index(size_t k, size_t n);
+
+        // sorted must be strictly increasing
+        void build(std::vector<ValueType>& sorted);
+        size_t lower_index(const ValueType& key) const;
+
+    public:
+        FrozenSet();
+
+        template <typename Allocator>
+        explicit
+        FrozenSet(const Set<ValueType, Allocator>& set);
+
+        template <typename InputIterator>
+        FrozenSet(InputIterator begin, InputIterator end);
+        FrozenSet(std::initializer_list<ValueType> init_list);
+
+        size_t size() const;
+        bool empty() const;
+
+        class iterator {
+        private:
+            friend class FrozenSet;
+
+            const FrozenSet* set;
+            size_t index;
+
+            iterator(const FrozenSet* _set, size_t _index)
+                : set(_set)
+                , index(_index) {
+            }
+
+        public:
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef ValueType value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const ValueType* pointer;
+            typedef const ValueType& reference;
+
+            iterator()
+                : set(nullptr)
+                , index(0) {
+            }
+
+            const ValueType& operator* () const {
+                return set->keys_[index - 1];
+            }
+
+            const ValueType* operator-> () const {
+                return &**this;
+            }
+
+            iterator& operator++ () {
+                index = next_index(index, set->keys_.size());
+                return *this;
+            }
+
+            iterator operator++ (int) {
+                iterator tmp(*this);
+                ++*this;
+                return tmp;
+            }
+
+            iterator& operator-- () {
+                if (index == 0) {
+                    index = last_index(set->keys_.size());
+                } else {
+                    index = prev_index(index, set->keys_.size());
+                }
+                return *this;
+            }
+
+            iterator operator-- (int) {
+                iterator tmp(*this);
+                --*this;
+                return tmp;
+            }
+
+            bool operator== (const iterator& other) const {
+                return index == other.index;
+            }
+
+            bool operator!= (const iterator& other) const {
+                return index != other.index;
+            }
+        };
+
+        iterator begin() const;
+        iterator end() const;
+
+        iterator find(const ValueType& key) const;
+        iterator lower_bound(const ValueType& key) const;
+    };
+}
+
+template <typename ValueType>
+size_t NSet::FrozenSet<ValueType>::trailing_ones(size_t k) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(~static_cast<unsigned long long>(k));
+#else
+    size_t ones = 0;
+    while (k & 1) {
+        k >>= 1;
+        ++ones;
+    }
+    return ones;
+#endif
+}
+
+template <typename ValueType>
+size_t NSet::FrozenSet<ValueType>::first_index(size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t k = 1;
+    while (2 * k <= n) {
+        k = 2 * k;
+    }
+    return k;
+}
+
+template <typename ValueType>
+size_t NSet::FrozenSet<ValueType>::last_index(size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t k = 1;
+    while (2 * k + 1 <= n) {
+        k = 2 * k + 1;
+    }
+    return k;
+}
+
+template <typename ValueType>
+size_t NSet::FrozenSet<ValueType>::next_index(size_t k, size_t n) {
+    if (2 * k + 1 <= n) {
+        k = 2 * k + 1;
+        while (2 * k <= n) {
+            k = 2 * k;
+        }
+        return k;
+    }
+    // climb while we are a right son, then once more
+    return k >> (trailing_ones(k) + 1);
+}
+
+template <typename ValueType>
+size_t NSet::FrozenSet<ValueType>::prev_index(size_t k, size_t n) {
+    if (2 * k <= n) {
+        k = 2 * k;
+        while (2 * k + 1 <= n) {
+            k = 2 * k + 1;
+        }
+        return k;
+    }
+    // climb while we are a left son, then once more
+    return k >> (trailing_ones(~k) + 1);
+}
+
+template <typename ValueType>
+void NSet::FrozenSet<ValueType>::build(std::vector<ValueType>& sorted) {
+    size_t n = sorted.size();
+    // in-order walk over the indices gives every node its rank
+    std::vector<size_t> rank(n + 1);
+    size_t k = first_index(n);
+    for (size_t i = 0; i < n; ++i) {
+        rank[k] = i;
+        k = next_index(k, n);
+    }
+    keys_.reserve(n);
+    for (size_t i = 1; i <= n; ++i) {
+        keys_.push_back(std::move(sorted[rank[i]]));
+    }
+}
+
+template <typename ValueType>
+NSet::FrozenSet<ValueType>::FrozenSet() {
+}
+
+template <typename ValueType>
+template <typename Allocator>
+NSet::FrozenSet<ValueType>::FrozenSet(const Set<ValueType, Allocator>& set) {
+    std::vector<ValueType> sorted(set.begin(), set.end());
+    build(sorted);
+}
+
+template <typename ValueType>
+template <typename InputIterator>
+NSet::FrozenSet<ValueType>::FrozenSet(InputIterator begin, InputIterator end) {
+    std::vector<ValueType> sorted(begin, end);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end(), [](const ValueType& a, const ValueType& b) {
+        return !(a < b);
+    }), sorted.end());
+    build(sorted);
+}
+
+template <typename ValueType>
+NSet::FrozenSet<ValueType>::FrozenSet(std::initializer_list<ValueType> init_list)
+    : FrozenSet(init_list.begin(), init_list.end()) {
+}
+
+template <typename ValueType>
+size_t NSet::FrozenSet<ValueType>::size() const {
+    return keys_.size();
+}
+
+template <typename ValueType>
+bool NSet::FrozenSet<ValueType>::empty() const {
+    return keys_.empty();
+}
+
+template <typename ValueType>
+size_t NSet::FrozenSet<ValueType>::lower_index(const ValueType& key) const {
+    const ValueType* keys = keys_.data();
+    size_t n = keys_.size();
+    size_t k = 1;
+    while (k <= n) {
+#if defined(__GNUC__)
+        __builtin_prefetch(keys + std::min(prefetch_stride() * k, n) - 1);
+#endif
+        k = 2 * k + (keys[k - 1] < key);
+    }
+    // the answer is where the walk last went left
+    return k >> (trailing_ones(k) + 1);
+}
+
+template <typename ValueType>
+typename NSet::FrozenSet<ValueType>::iterator NSet::FrozenSet<ValueType>::begin() const {
+    return iterator(this, first_index(keys_.size()));
+}
+
+template <typename ValueType>
+typename NSet::FrozenSet<ValueType>::iterator NSet::FrozenSet<ValueType>::end() const {
+    return iterator(this, 0);
+}
+
+template <typename ValueType>
+typename NSet::FrozenSet<ValueType>::iterator NSet::FrozenSet<ValueType>::find(const ValueType& key) const {
+    size_t k = lower_index(key);
+    if (k == 0 || key < keys_[k - 1]) {
+        return end();
+    }
+    return iterator(this, k);
+}
+
+template <typename ValueType>
+typename NSet::FrozenSet<ValueType>::iterator NSet::FrozenSet<ValueType>::lower_bound(const ValueType& key) const {
+    return iterator(this, lower_index(key));
+}
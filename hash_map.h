@@ -1,44 +1,241 @@
 #pragma once
 #include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <list>
+#include <memory>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "pool_allocator.h"
+
 namespace HashMap {
 // let's make min amount of buckets 32
     constexpr const size_t MinBuckAmount = 32;
+    // batched lookups hash that many keys ahead and prefetch their buckets
+    constexpr const size_t PrefetchBatch = 16;
+
+    // finalizing mix, so weak hashes like std::hash<int> still spread over the buckets
+    inline size_t mix_hash(size_t hash) {
+        uint64_t h = hash;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return static_cast<size_t>(h);
+    }
+
+    // bucket of a hash among count buckets, count is a power of two
+    inline size_t bucket_index(size_t hash, size_t count) {
+        return mix_hash(hash) & (count - 1);
+    }
+
+    // shard of a hash among count shards, a power of two; the shards take the upper half
+    // of the bits, above the ones the buckets of a shard use, so both spread well
+    inline size_t shard_index(size_t hash, size_t count) {
+        return (mix_hash(hash) >> (std::numeric_limits<size_t>::digits / 2)) & (count - 1);
+    }
+
+    // how the map is rebuilt when it grows or shrinks
+    struct DefaultPolicy {
+        // the elements move to the new buckets all at once
+        static constexpr bool incremental_rehash = false;
+        // while rehashing incrementally every insert and erase moves that many old buckets
+        static constexpr size_t migrate_buckets = 16;
+        // every element keeps its full hash, rebuilds never call the hasher
+        // and keys are compared only when the hashes are equal
+        static constexpr bool cache_hash = false;
+        // the map doubles when elements / buckets reaches max_load_factor
+        // and halves when it falls to min_load_factor, if shrink is on
+        static constexpr double max_load_factor = 0.5;
+        static constexpr double min_load_factor = 0.125;
+        static constexpr bool shrink = true;
+    };
+
+    // spreads a rebuild over the following inserts and erases, so none of them stalls
+    struct IncrementalPolicy : DefaultPolicy {
+        static constexpr bool incremental_rehash = true;
+    };
+
+    struct CachedHashPolicy : DefaultPolicy {
+        static constexpr bool cache_hash = true;
+    };
+
+    // for maps that are emptied and refilled: erase never rebuilds, only shrink_to_fit does
+    struct NoShrinkPolicy : DefaultPolicy {
+        static constexpr bool shrink = false;
+    };
 
-    template<class KeyType, class ValueType, class Hash = std::hash<KeyType>>
+    // what a chain stores: the element and, if asked for, its hash
+    template<class KeyType, class ValueType, bool cache_hash>
+    struct Entry {
+        std::pair<KeyType, ValueType> element;
+        size_t hash;
+
+        template<typename... Args>
+        explicit Entry(size_t _hash, Args &&... args)
+                : element(std::forward<Args>(args)...), hash(_hash) {}
+
+        template<class Hash>
+        size_t get_hash(const Hash &) const {
+            return hash;
+        }
+
+        void set_hash(size_t _hash) {
+            hash = _hash;
+        }
+
+        bool may_be(size_t _hash) const {
+            return hash == _hash;
+        }
+    };
+
+    template<class KeyType, class ValueType>
+    struct Entry<KeyType, ValueType, false> {
+        std::pair<KeyType, ValueType> element;
+
+        template<typename... Args>
+        explicit Entry(size_t, Args &&... args)
+                : element(std::forward<Args>(args)...) {}
+
+        template<class Hash>
+        size_t get_hash(const Hash &hasher) const {
+            return hasher(element.first);
+        }
+
+        void set_hash(size_t) {
+        }
+
+        bool may_be(size_t) const {
+            return true;
+        }
+    };
+
+    // Allocator gives the nodes of the chains, rebound from std::pair<const KeyType, ValueType>;
+    // all chains of a map share one allocator, so a stateful one like NAlloc::PoolAllocator
+    // keeps the nodes of a table in the same blocks and reuses the erased ones
+    template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class Policy = DefaultPolicy,
+            class Allocator = std::allocator<std::pair<const KeyType, ValueType>>>
     class HashMap {
+        static_assert(!Policy::shrink || 2 * Policy::min_load_factor < Policy::max_load_factor,
+                      "a map halved at min_load_factor has to stay below max_load_factor");
+
     private:
+        typedef Entry<KeyType, ValueType, Policy::cache_hash> entry_type;
+        typedef typename std::allocator_traits<Allocator>::template rebind_alloc<entry_type> entry_allocator;
+        typedef std::list<entry_type, entry_allocator> chain_type;
+        typedef std::vector<chain_type,
+                typename std::allocator_traits<Allocator>::template rebind_alloc<chain_type>> buckets_type;
+
         size_t map_size;
         Hash hasher;
-        std::vector<std::list<std::pair<KeyType, ValueType>>> map;
-
-        // rebuilds current map so that 1 / 8 <= elements / buckets <= 1 / 2
+        entry_allocator allocator;
+        buckets_type map;
+        // buckets that are still being moved into map, the ones before migrated are empty
+        buckets_type old_map;
+        size_t migrated;
+
+        // count empty chains, each built from allocator: copying an empty chain instead
+        // would give every copy an allocator of its own (a fresh arena for PoolAllocator)
+        buckets_type make_buckets(size_t) const;
+
+        // rebuilds current map with the given amount of buckets, a power of two;
+        // the load stays between Policy::min_load_factor and Policy::max_load_factor,
         // so there is O(n) buckets in every time
         void rebuild(size_t);
 
+        // least power of two of buckets, at least MinBuckAmount, that holds elements below the max load
+        static size_t buckets_for(size_t elements);
+
+        // moves the nodes of up to the given amount of old buckets into map
+        void migrate(size_t);
+
+        // buckets of map go first, then the ones of old_map
+        size_t chains_number() const {
+            return map.size() + old_map.size();
+        }
+
+        chain_type &chain(size_t index) {
+            return index < map.size() ? map[index] : old_map[index - map.size()];
+        }
+
+        const chain_type &chain(size_t index) const {
+            return index < map.size() ? map[index] : old_map[index - map.size()];
+        }
+
+        // the bucket holding key with the given hash and the key's place in it,
+        // the bucket of map and its end if key is not there
+        template<class K>
+        std::pair<size_t, typename chain_type::const_iterator> locate(const K &, size_t) const;
+
+        template<class K>
+        std::pair<size_t, typename chain_type::iterator> locate(const K &, size_t);
+
+        // grows the map after an insert, says if it was rebuilt
+        bool grow();
+
+        static void prefetch(const void *address) {
+#if defined(__GNUC__)
+            __builtin_prefetch(address);
+#else
+            (void) address;
+#endif
+        }
+
+        // calls f(i, hash of key(i)) for every i < count, prefetching the buckets
+        // and then the first nodes of the keys ahead, so their misses overlap;
+        // nothing is prefetched while old buckets are migrating
+        template<class GetKey, class F>
+        void pipeline(size_t, GetKey key, F f) const;
+
     public:
         explicit
-        HashMap(const Hash &_hasher = Hash())
-                : map_size(0), hasher(_hasher), map(MinBuckAmount) {
+        HashMap(const Hash &_hasher = Hash(), const Allocator &_allocator = Allocator())
+                : map_size(0), hasher(_hasher), allocator(_allocator),
+                  map(make_buckets(MinBuckAmount)), old_map(allocator), migrated(0) {
         }
 
         template<typename InputIterator>
         HashMap(InputIterator begin,
                 InputIterator end,
-                const Hash &_hasher = Hash())
-                : HashMap(_hasher) {
+                const Hash &_hasher = Hash(),
+                const Allocator &_allocator = Allocator())
+                : HashMap(_hasher, _allocator) {
+            // a range that can be walked twice is counted first, so the map is built once
+            if (std::is_base_of<std::forward_iterator_tag,
+                    typename std::iterator_traits<InputIterator>::iterator_category>::value)
+                reserve(std::distance(begin, end));
             while (begin != end)
                 insert(*(begin++));
         }
 
         HashMap(std::initializer_list<std::pair<KeyType, ValueType>> init_list,
-                const Hash &_hasher = Hash())
-                : HashMap(init_list.begin(), init_list.end(), _hasher) {}
+                const Hash &_hasher = Hash(),
+                const Allocator &_allocator = Allocator())
+                : HashMap(init_list.begin(), init_list.end(), _hasher, _allocator) {}
+
+        // the copy keeps the bucket count and gets the allocator
+        // select_on_container_copy_construction gives, shared by all its chains
+        HashMap(const HashMap &);
+
+        // other is left empty with MinBuckAmount buckets, begin() and the lookups need at least one
+        HashMap(HashMap &&);
+
+        HashMap &operator=(const HashMap &);
+
+        HashMap &operator=(HashMap &&);
+
+        void swap(HashMap &);
+
+        Allocator get_allocator() const {
+            return Allocator(allocator);
+        }
 
         size_t size() const {
             return map_size;
@@ -52,14 +249,38 @@ namespace HashMap {
             return hasher;
         }
 
+        size_t bucket_count() const {
+            return map.size();
+        }
+
+        double load_factor() const {
+            return static_cast<double>(map_size) / map.size();
+        }
+
+        // makes room for count elements, so inserting up to them won't rebuild the map
+        void reserve(size_t count);
+
+        // rebuilds the map with at least count buckets, rounded up to a power of two,
+        // but never with fewer than its elements need
+        void rehash(size_t count);
+
+        // rebuilds the map with the fewest buckets its elements need
+        void shrink_to_fit();
+
         void insert(std::pair<KeyType, ValueType> &&);
 
         void insert(const std::pair<KeyType, ValueType> &);
 
         void erase(const KeyType &);
 
+        // lookups by anything the hash accepts, if Hash::is_transparent is there
+        template<class K, class H = Hash, class = typename H::is_transparent>
+        void erase(const K &);
+
         ValueType &operator[](const KeyType &);
 
+        ValueType &operator[](KeyType &&);
+
         void clear();
 
     private:
@@ -70,17 +291,17 @@ namespace HashMap {
                 typedef typename std::conditional<is_const,
                         const std::pair<const KeyType, ValueType>, std::pair<const KeyType, ValueType>>::type PairType;
                 typedef typename std::conditional<is_const,
-                        typename std::list<std::pair<KeyType, ValueType>>::const_iterator,
-                        typename std::list<std::pair<KeyType, ValueType>>::iterator>::type IterType;
+                        typename chain_type::const_iterator,
+                        typename chain_type::iterator>::type IterType;
                 HashMapPtr ptr;
                 std::size_t veciter;
                 IterType it;
 
                 base_iterator& find_next() {
-                    while (it == ptr->map[veciter].end()) {
-                        if (veciter + 1 == ptr->map.size())
+                    while (it == ptr->chain(veciter).end()) {
+                        if (veciter + 1 == ptr->chains_number())
                             return *this;
-                        it = ptr->map[++veciter].begin();
+                        it = ptr->chain(++veciter).begin();
                     }
                     return *this;
                 }
@@ -104,7 +325,7 @@ namespace HashMap {
                 }
 
                 base_iterator& operator++() {
-                    if (it == ptr->map[veciter].end() && veciter + 1 == ptr->map.size())
+                    if (it == ptr->chain(veciter).end() && veciter + 1 == ptr->chains_number())
                         return *this;
                     ++it;
                     return find_next();
@@ -117,13 +338,13 @@ namespace HashMap {
                 }
 
                 PairType& operator*() const {
-                    auto& ret = reinterpret_cast<PairType&>(*it);
+                    auto& ret = reinterpret_cast<PairType&>(it->element);
                     return ret;
                 }
 
                 PairType*
                 operator->() const {
-                    auto* ret = reinterpret_cast<PairType*>(&*it);
+                    auto* ret = reinterpret_cast<PairType*>(&it->element);
                     return ret;
                 }
         };
@@ -141,113 +362,494 @@ namespace HashMap {
         }
 
         iterator end() {
-            return iterator(this, map.size() - 1, map[map.size() - 1].end());
+            return iterator(this, chains_number() - 1, chain(chains_number() - 1).end());
         }
 
         const_iterator end() const {
-            return const_iterator(this, map.size() - 1, map[map.size() - 1].cend());
+            return const_iterator(this, chains_number() - 1, chain(chains_number() - 1).cend());
         }
 
         iterator find(const KeyType &);
 
         const_iterator find(const KeyType &) const;
 
+        template<class K, class H = Hash, class = typename H::is_transparent>
+        iterator find(const K &);
+
+        template<class K, class H = Hash, class = typename H::is_transparent>
+        const_iterator find(const K &) const;
+
         const ValueType &at(const KeyType &) const;
+
+        template<class K, class H = Hash, class = typename H::is_transparent>
+        const ValueType &at(const K &) const;
+
+        // all of them hash the key once and build the element in place,
+        // the bool is true if the element is new
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const KeyType &, Args &&...);
+
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(KeyType &&, Args &&...);
+
+        // the element is built before the lookup and thrown away if the key is there
+        template<typename... Args>
+        std::pair<iterator, bool> emplace(Args &&...);
+
+        template<class M>
+        std::pair<iterator, bool> insert_or_assign(const KeyType &, M &&);
+
+        template<class M>
+        std::pair<iterator, bool> insert_or_assign(KeyType &&, M &&);
+
+        // batched versions for long runs of keys: the keys are hashed and their buckets
+        // prefetched PrefetchBatch at a time, result[i] is the answer for keys[i]
+        void find_many(const KeyType *keys, size_t count, iterator *result);
+
+        void find_many(const KeyType *keys, size_t count, const_iterator *result) const;
+
+        void contains_many(const KeyType *keys, size_t count, bool *result) const;
+
+        void insert_many(const std::pair<KeyType, ValueType> *elements, size_t count);
+
+    private:
+        template<class K, typename... Args>
+        std::pair<iterator, bool> emplace_key(size_t, K &&, Args &&...);
+
+        template<class K>
+        void erase_key(const K &);
     };
 
-    template<class KeyType, class ValueType, class Hash>
-    void HashMap<KeyType, ValueType, Hash>::rebuild(size_t newmap_size) {
-        std::vector<std::list<std::pair<KeyType, ValueType>>> newmap(newmap_size);
-        for (auto &element : *this) {
-            newmap[hasher(element.first) % newmap.size()].push_back(element);
+    // HashMap whose nodes come from an arena of its own
+    template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class Policy = DefaultPolicy>
+    using PooledHashMap = HashMap<KeyType, ValueType, Hash, Policy,
+            NAlloc::PoolAllocator<std::pair<const KeyType, ValueType>>>;
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::buckets_type
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::make_buckets(size_t count) const {
+        buckets_type buckets(allocator);
+        buckets.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            buckets.emplace_back(allocator);
+        return buckets;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::HashMap(const HashMap &other)
+            : map_size(other.map_size), hasher(other.hasher),
+              allocator(std::allocator_traits<entry_allocator>::select_on_container_copy_construction(other.allocator)),
+              map(make_buckets(other.map.size())), old_map(allocator), migrated(0) {
+        // the elements of old buckets land in map right away
+        for (size_t index = 0; index < other.chains_number(); ++index) {
+            for (const auto &entry : other.chain(index)) {
+                size_t hash = entry.get_hash(hasher);
+                map[bucket_index(hash, map.size())].emplace_back(hash, entry.element);
+            }
+        }
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::HashMap(HashMap &&other)
+            : HashMap(other.hasher, Allocator(other.allocator)) {
+        swap(other);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator> &
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::operator=(const HashMap &other) {
+        if (this != &other)
+            *this = HashMap(other);
+        return *this;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator> &
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::operator=(HashMap &&other) {
+        if (this != &other) {
+            HashMap tmp(std::move(other));
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::swap(HashMap &other) {
+        std::swap(map_size, other.map_size);
+        std::swap(hasher, other.hasher);
+        std::swap(allocator, other.allocator);
+        map.swap(other.map);
+        old_map.swap(other.old_map);
+        std::swap(migrated, other.migrated);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::rebuild(size_t newmap_size) {
+        // nodes are relinked, nothing is copied or allocated but the buckets
+        migrate(old_map.size());
+        buckets_type newmap = make_buckets(newmap_size);
+        if (Policy::incremental_rehash) {
+            std::swap(map, newmap);
+            std::swap(old_map, newmap);
+            migrated = 0;
+            return;
+        }
+        for (auto &oldchain : map) {
+            while (!oldchain.empty()) {
+                auto &newchain = newmap[bucket_index(oldchain.front().get_hash(hasher), newmap.size())];
+                newchain.splice(newchain.end(), oldchain, oldchain.begin());
+            }
         }
         std::swap(map, newmap);
     }
 
-    template<class KeyType, class ValueType, class Hash>
-    void HashMap<KeyType, ValueType, Hash>::insert(
-            std::pair<KeyType, ValueType> &&element) {
-        auto hash_value = hasher(element.first) % map.size();
-        for (const auto &el : map[hash_value]) {
-            auto key = el.first;
-            if (key == element.first)
-                return;
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    size_t HashMap<KeyType, ValueType, Hash, Policy, Allocator>::buckets_for(size_t elements) {
+        size_t buckets = MinBuckAmount;
+        while (elements >= Policy::max_load_factor * buckets)
+            buckets *= 2;
+        return buckets;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::reserve(size_t count) {
+        size_t buckets = buckets_for(count);
+        if (buckets > map.size())
+            rebuild(buckets);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::rehash(size_t count) {
+        size_t buckets = buckets_for(map_size);
+        while (buckets < count)
+            buckets *= 2;
+        if (buckets != map.size())
+            rebuild(buckets);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::shrink_to_fit() {
+        rehash(0);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::migrate(size_t buckets) {
+        if (old_map.empty())
+            return;
+        for (; buckets != 0 && migrated != old_map.size(); --buckets, ++migrated) {
+            auto &oldchain = old_map[migrated];
+            while (!oldchain.empty()) {
+                auto &newchain = map[bucket_index(oldchain.front().get_hash(hasher), map.size())];
+                newchain.splice(newchain.end(), oldchain, oldchain.begin());
+            }
+        }
+        if (migrated == old_map.size()) {
+            buckets_type(allocator).swap(old_map);
+            migrated = 0;
         }
-        map[hash_value].push_back(element);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class K>
+    std::pair<size_t, typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::chain_type::const_iterator>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::locate(const K &key, size_t hash) const {
+        if (!old_map.empty()) {
+            auto old_value = bucket_index(hash, old_map.size());
+            if (old_value >= migrated) {
+                const auto &oldchain = old_map[old_value];
+                for (auto it = oldchain.begin(); it != oldchain.end(); ++it) {
+                    if (it->may_be(hash) && it->element.first == key)
+                        return {map.size() + old_value, it};
+                }
+            }
+        }
+        auto hash_value = bucket_index(hash, map.size());
+        const auto &keychain = map[hash_value];
+        for (auto it = keychain.begin(); it != keychain.end(); ++it) {
+            if (it->may_be(hash) && it->element.first == key)
+                return {hash_value, it};
+        }
+        return {hash_value, keychain.end()};
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class K>
+    std::pair<size_t, typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::chain_type::iterator>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::locate(const K &key, size_t hash) {
+        auto place = static_cast<const HashMap *>(this)->locate(key, hash);
+        // erasing nothing turns the const iterator into a mutable one
+        auto &keychain = chain(place.first);
+        return {place.first, keychain.erase(place.second, place.second)};
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    bool HashMap<KeyType, ValueType, Hash, Policy, Allocator>::grow() {
+        if (map_size < Policy::max_load_factor * map.size())
+            return false;
+        rebuild(2 * map.size());
+        return true;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class GetKey, class F>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::pipeline(size_t count, GetKey key, F f) const {
+        // key i is hashed and its bucket prefetched, the first node of key i - PrefetchBatch / 2
+        // is prefetched and key i - PrefetchBatch is handed to f; hashes keeps the last PrefetchBatch hashes
+        size_t hashes[PrefetchBatch];
+        const size_t ahead = PrefetchBatch / 2;
+        for (size_t i = 0; i < count + PrefetchBatch; ++i) {
+            if (i >= PrefetchBatch) {
+                size_t j = i - PrefetchBatch;
+                if (j >= count)
+                    break;
+                f(j, hashes[j % PrefetchBatch]);
+            }
+            if (old_map.empty() && i >= ahead && i - ahead < count) {
+                const auto &keychain = map[bucket_index(hashes[(i - ahead) % PrefetchBatch], map.size())];
+                if (!keychain.empty())
+                    prefetch(&keychain.front());
+            }
+            if (i < count) {
+                hashes[i % PrefetchBatch] = hasher(key(i));
+                if (old_map.empty())
+                    prefetch(&map[bucket_index(hashes[i % PrefetchBatch], map.size())]);
+            }
+        }
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::find_many(const KeyType *keys, size_t count, iterator *result) {
+        pipeline(count, [keys](size_t i) -> const KeyType & { return keys[i]; },
+                 [this, keys, result](size_t i, size_t hash) {
+                     auto place = locate(keys[i], hash);
+                     if (place.second == chain(place.first).end())
+                         result[i] = end();
+                     else
+                         result[i] = iterator(this, place.first, place.second);
+                 });
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::find_many(const KeyType *keys, size_t count,
+                                                              const_iterator *result) const {
+        pipeline(count, [keys](size_t i) -> const KeyType & { return keys[i]; },
+                 [this, keys, result](size_t i, size_t hash) {
+                     auto place = locate(keys[i], hash);
+                     if (place.second == chain(place.first).end())
+                         result[i] = end();
+                     else
+                         result[i] = const_iterator(this, place.first, place.second);
+                 });
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::contains_many(const KeyType *keys, size_t count,
+                                                                  bool *result) const {
+        pipeline(count, [keys](size_t i) -> const KeyType & { return keys[i]; },
+                 [this, keys, result](size_t i, size_t hash) {
+                     auto place = locate(keys[i], hash);
+                     result[i] = place.second != chain(place.first).end();
+                 });
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::insert_many(const std::pair<KeyType, ValueType> *elements,
+                                                                size_t count) {
+        // a rebuild in the middle only wastes the prefetches made before it
+        pipeline(count, [elements](size_t i) -> const KeyType & { return elements[i].first; },
+                 [this, elements](size_t i, size_t hash) {
+                     emplace_key(hash, elements[i].first, elements[i].second);
+                 });
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class K, typename... Args>
+    std::pair<typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::iterator, bool>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::emplace_key(size_t hash, K &&key, Args &&... args) {
+        migrate(Policy::migrate_buckets);
+        auto place = locate(key, hash);
+        auto &keychain = chain(place.first);
+        if (place.second != keychain.end())
+            return {iterator(this, place.first, place.second), false};
+        keychain.emplace_back(hash, std::piecewise_construct,
+                              std::forward_as_tuple(std::forward<K>(key)),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
         ++map_size;
-        if (2 * map_size >= map.size())
-            rebuild(2 * map.size());
+        auto it = std::prev(keychain.end());
+        if (grow())
+            // the node was relinked, the hash tells where it went
+            place = locate(it->element.first, hash);
+        return {iterator(this, place.first, it), true};
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<typename... Args>
+    std::pair<typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::iterator, bool>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::try_emplace(const KeyType &key, Args &&... args) {
+        return emplace_key(hasher(key), key, std::forward<Args>(args)...);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<typename... Args>
+    std::pair<typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::iterator, bool>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::try_emplace(KeyType &&key, Args &&... args) {
+        return emplace_key(hasher(key), std::move(key), std::forward<Args>(args)...);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<typename... Args>
+    std::pair<typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::iterator, bool>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::emplace(Args &&... args) {
+        // the new element waits in a chain of its own and is spliced in if it is new
+        chain_type cell(allocator);
+        cell.emplace_back(0, std::forward<Args>(args)...);
+        auto it = cell.begin();
+        migrate(Policy::migrate_buckets);
+        auto hash = hasher(it->element.first);
+        it->set_hash(hash);
+        auto place = locate(it->element.first, hash);
+        auto &keychain = chain(place.first);
+        if (place.second != keychain.end())
+            return {iterator(this, place.first, place.second), false};
+        keychain.splice(keychain.end(), cell);
+        ++map_size;
+        if (grow())
+            place = locate(it->element.first, hash);
+        return {iterator(this, place.first, it), true};
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class M>
+    std::pair<typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::iterator, bool>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::insert_or_assign(const KeyType &key, M &&obj) {
+        auto ret = emplace_key(hasher(key), key, std::forward<M>(obj));
+        if (!ret.second)
+            ret.first->second = std::forward<M>(obj);
+        return ret;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class M>
+    std::pair<typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::iterator, bool>
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::insert_or_assign(KeyType &&key, M &&obj) {
+        auto ret = emplace_key(hasher(key), std::move(key), std::forward<M>(obj));
+        if (!ret.second)
+            ret.first->second = std::forward<M>(obj);
+        return ret;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::insert(
+            std::pair<KeyType, ValueType> &&element) {
+        emplace_key(hasher(element.first), std::move(element.first), std::move(element.second));
     }
 
-    template<class KeyType, class ValueType, class Hash>
-    void HashMap<KeyType, ValueType, Hash>::insert(
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::insert(
             const std::pair<KeyType, ValueType> &element) {
-        insert(std::pair<KeyType, ValueType>(element));
+        emplace_key(hasher(element.first), element.first, element.second);
     }
 
-    template<class KeyType, class ValueType, class Hash>
-    void HashMap<KeyType, ValueType, Hash>::erase(const KeyType &key) {
-        auto hash_value = hasher(key) % map.size();
-        for (auto it = map[hash_value].begin(); it != map[hash_value].end(); ++it) {
-            if (it->first == key) {
-                map[hash_value].erase(it);
-                --map_size;
-                break;
-            }
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class K>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::erase_key(const K &key) {
+        migrate(Policy::migrate_buckets);
+        auto place = locate(key, hasher(key));
+        auto &keychain = chain(place.first);
+        if (place.second != keychain.end()) {
+            keychain.erase(place.second);
+            --map_size;
         }
-        if (8 * map_size <= map.size())
+        if (Policy::shrink && map_size <= Policy::min_load_factor * map.size() && map.size() > MinBuckAmount)
             // but map.size() needs to be at least MinBuckAmount
             rebuild(std::max(MinBuckAmount, map.size() / 2));
     }
 
-    template<class KeyType, class ValueType, class Hash>
-    ValueType &HashMap<KeyType, ValueType, Hash>::operator[](
-            const KeyType &_key) {
-        for (auto &element : map[hasher(_key) % map.size()]) {
-            auto key = element.first;
-            auto &val = element.second;
-            if (key == _key)
-                return val;
-        }
-        insert({_key, ValueType{}});
-        return map[hasher(_key) % map.size()].rbegin()->second;
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::erase(const KeyType &key) {
+        erase_key(key);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class K, class H, class>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::erase(const K &key) {
+        erase_key(key);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    ValueType &HashMap<KeyType, ValueType, Hash, Policy, Allocator>::operator[](
+            const KeyType &key) {
+        return emplace_key(hasher(key), key).first->second;
     }
 
-    template<class KeyType, class ValueType, class Hash>
-    void HashMap<KeyType, ValueType, Hash>::clear() {
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    ValueType &HashMap<KeyType, ValueType, Hash, Policy, Allocator>::operator[](
+            KeyType &&key) {
+        return emplace_key(hasher(key), std::move(key)).first->second;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void HashMap<KeyType, ValueType, Hash, Policy, Allocator>::clear() {
         for (auto &chain : map)
             chain.clear();
-        map.resize(MinBuckAmount);
+        if (Policy::shrink)
+            map.resize(MinBuckAmount);
+        buckets_type(allocator).swap(old_map);
+        migrated = 0;
         map_size = 0;
     }
 
-    template<class KeyType, class ValueType, class Hash>
-    typename HashMap<KeyType, ValueType, Hash>::iterator
-    HashMap<KeyType, ValueType, Hash>::find(const KeyType &key) {
-        auto hash_value = hasher(key) % map.size();
-        for (auto it = map[hash_value].begin(); it != map[hash_value].end(); ++it) {
-            if (it->first == key)
-                return HashMap<KeyType, ValueType, Hash>::iterator(
-                        this, hash_value, it);
-        }
-        return end();
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::iterator
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::find(const KeyType &key) {
+        auto place = locate(key, hasher(key));
+        if (place.second == chain(place.first).end())
+            return end();
+        return iterator(this, place.first, place.second);
     }
 
-    template<class KeyType, class ValueType, class Hash>
-    typename HashMap<KeyType, ValueType, Hash>::const_iterator
-    HashMap<KeyType, ValueType, Hash>::find(const KeyType &key) const {
-        auto hash_value = hasher(key) % map.size();
-        for (auto it = map[hash_value].begin(); it != map[hash_value].end(); ++it) {
-            if (it->first == key)
-                return HashMap<KeyType, ValueType, Hash>::const_iterator(
-                        this, hash_value, it);
-        }
-        return end();
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::const_iterator
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::find(const KeyType &key) const {
+        auto place = locate(key, hasher(key));
+        if (place.second == chain(place.first).end())
+            return end();
+        return const_iterator(this, place.first, place.second);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class K, class H, class>
+    typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::iterator
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::find(const K &key) {
+        auto place = locate(key, hasher(key));
+        if (place.second == chain(place.first).end())
+            return end();
+        return iterator(this, place.first, place.second);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class K, class H, class>
+    typename HashMap<KeyType, ValueType, Hash, Policy, Allocator>::const_iterator
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::find(const K &key) const {
+        auto place = locate(key, hasher(key));
+        if (place.second == chain(place.first).end())
+            return end();
+        return const_iterator(this, place.first, place.second);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    const ValueType &
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::at(const KeyType &key) const {
+        const_iterator it = find(key);
+        if (it == end())
+            throw std::out_of_range("");
+        return it->second;
     }
 
-    template<class KeyType, class ValueType, class Hash>
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    template<class K, class H, class>
     const ValueType &
-    HashMap<KeyType, ValueType, Hash>::at(const KeyType &key) const {
+    HashMap<KeyType, ValueType, Hash, Policy, Allocator>::at(const K &key) const {
         const_iterator it = find(key);
         if (it == end())
             throw std::out_of_range("");
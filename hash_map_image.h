@@ -0,0 +1,278 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash_map.h"
+
+namespace HashMap {
+    // a HashMap of trivially copyable keys and values saved as one position independent block:
+    //   ImageHeader
+    //   offsets[buckets + 1]  the entries of bucket b are entries[offsets[b]] .. entries[offsets[b + 1]]
+    //   entries[size]         ImageEntry records grouped by bucket
+    // buckets are picked with bucket_index like in the live map, so Hash has to give
+    // the same values in the process that reads the image as in the one that wrote it
+    struct ImageHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t entry_size;
+        uint32_t key_size;
+        uint32_t value_size;
+        uint64_t size;
+        uint64_t buckets;
+        // from the start of the image
+        uint64_t offsets_offset;
+        uint64_t entries_offset;
+        uint64_t image_size;
+    };
+
+    constexpr const char ImageMagic[8] = {'H', 'M', 'I', 'M', 'A', 'G', 'E', '\0'};
+    constexpr const uint32_t ImageVersion = 1;
+    // the sections start on cache lines
+    constexpr const uint64_t ImageAlign = 64;
+
+    template<class KeyType, class ValueType>
+    struct ImageEntry {
+        KeyType first;
+        ValueType second;
+    };
+
+    inline uint64_t image_align(uint64_t offset) {
+        return (offset + ImageAlign - 1) / ImageAlign * ImageAlign;
+    }
+
+    // writes the image of map to path, throws std::runtime_error if it can't
+    template<class KeyType, class ValueType, class Hash, class Policy, class Allocator>
+    void save_image(const HashMap<KeyType, ValueType, Hash, Policy, Allocator> &map, const std::string &path) {
+        static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                      "only trivially copyable keys and values can be saved");
+        typedef ImageEntry<KeyType, ValueType> entry_type;
+
+        ImageHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, ImageMagic, sizeof(header.magic));
+        header.version = ImageVersion;
+        header.entry_size = sizeof(entry_type);
+        header.key_size = sizeof(KeyType);
+        header.value_size = sizeof(ValueType);
+        header.size = map.size();
+        header.buckets = map.bucket_count();
+        header.offsets_offset = image_align(sizeof(ImageHeader));
+        header.entries_offset = image_align(header.offsets_offset + (header.buckets + 1) * sizeof(uint64_t));
+        header.image_size = header.entries_offset + header.size * sizeof(entry_type);
+
+        // counting sort of the elements by bucket, iteration order is the same in both passes
+        Hash hasher = map.hash_function();
+        std::vector<uint64_t> offsets(header.buckets + 1, 0);
+        std::vector<size_t> bucket_of;
+        bucket_of.reserve(map.size());
+        for (const auto &element : map) {
+            bucket_of.push_back(bucket_index(hasher(element.first), header.buckets));
+            ++offsets[bucket_of.back() + 1];
+        }
+        for (size_t bucket = 0; bucket < header.buckets; ++bucket)
+            offsets[bucket + 1] += offsets[bucket];
+        std::vector<entry_type> entries(map.size());
+        std::vector<uint64_t> next(offsets.begin(), offsets.end() - 1);
+        size_t index = 0;
+        for (const auto &element : map) {
+            entry_type &entry = entries[next[bucket_of[index++]]++];
+            entry.first = element.first;
+            entry.second = element.second;
+        }
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        const char padding[ImageAlign] = {};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(padding, header.offsets_offset - sizeof(header));
+        out.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        out.write(padding, header.entries_offset - header.offsets_offset - offsets.size() * sizeof(uint64_t));
+        out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(entry_type));
+        out.close();
+        if (!out)
+            throw std::runtime_error("can't write the image to " + path);
+    }
+
+    // read-only HashMap over an image, either mapped from a file or lying in memory;
+    // lookups go to the bucket the live map would use and nothing is deserialized
+    template<class KeyType, class ValueType, class Hash = std::hash<KeyType>>
+    class HashMapView {
+    public:
+        typedef ImageEntry<KeyType, ValueType> value_type;
+        typedef const value_type *const_iterator;
+        typedef const_iterator iterator;
+
+    private:
+        Hash hasher;
+        // the mapping if the view owns one
+        void *mapping;
+        size_t mapping_size;
+        const ImageHeader *header;
+        const uint64_t *offsets;
+        const value_type *entries;
+
+        // checks the header and sets the section pointers
+        void attach(const void *image, size_t image_size);
+
+        void unmap();
+
+    public:
+        // maps the file at path, throws std::runtime_error if it is not an image of this map
+        explicit
+        HashMapView(const std::string &path, const Hash &_hasher = Hash());
+
+        // image has to stay alive while the view is used, throws std::invalid_argument
+        // if it is not aligned to ImageAlign
+        HashMapView(const void *image, size_t image_size, const Hash &_hasher = Hash())
+                : hasher(_hasher), mapping(nullptr), mapping_size(0) {
+            if (reinterpret_cast<uintptr_t>(image) % ImageAlign != 0)
+                throw std::invalid_argument("the HashMap image is not aligned");
+            attach(image, image_size);
+        }
+
+        HashMapView(const HashMapView &) = delete;
+
+        HashMapView &operator=(const HashMapView &) = delete;
+
+        HashMapView(HashMapView &&other) noexcept;
+
+        ~HashMapView() {
+            unmap();
+        }
+
+        size_t size() const {
+            return header->size;
+        }
+
+        bool empty() const {
+            return header->size == 0;
+        }
+
+        size_t bucket_count() const {
+            return header->buckets;
+        }
+
+        Hash hash_function() const {
+            return hasher;
+        }
+
+        // elements come bucket by bucket
+        const_iterator begin() const {
+            return entries;
+        }
+
+        const_iterator end() const {
+            return entries + header->size;
+        }
+
+        const_iterator find(const KeyType &) const;
+
+        const ValueType &at(const KeyType &) const;
+    };
+
+    template<class KeyType, class ValueType, class Hash>
+    void HashMapView<KeyType, ValueType, Hash>::attach(const void *image, size_t image_size) {
+        static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                      "only trivially copyable keys and values can be viewed");
+        header = static_cast<const ImageHeader *>(image);
+        if (image_size < sizeof(ImageHeader)
+            || std::memcmp(header->magic, ImageMagic, sizeof(ImageMagic)) != 0
+            || header->version != ImageVersion)
+            throw std::runtime_error("not a HashMap image");
+        if (header->entry_size != sizeof(value_type)
+            || header->key_size != sizeof(KeyType)
+            || header->value_size != sizeof(ValueType))
+            throw std::runtime_error("the HashMap image holds other types");
+        // the sizes are compared by division, so a hostile header can't overflow them past the checks
+        uint64_t total = header->image_size;
+        if (total > image_size
+            || header->buckets == 0 || (header->buckets & (header->buckets - 1)) != 0
+            || header->offsets_offset % ImageAlign != 0 || header->entries_offset % ImageAlign != 0
+            || header->offsets_offset < sizeof(ImageHeader)
+            || header->entries_offset < header->offsets_offset || header->entries_offset > total
+            || (header->entries_offset - header->offsets_offset) / sizeof(uint64_t) <= header->buckets
+            || (total - header->entries_offset) % sizeof(value_type) != 0
+            || (total - header->entries_offset) / sizeof(value_type) != header->size)
+            throw std::runtime_error("the HashMap image is damaged");
+        const char *base = static_cast<const char *>(image);
+        offsets = reinterpret_cast<const uint64_t *>(base + header->offsets_offset);
+        entries = reinterpret_cast<const value_type *>(base + header->entries_offset);
+        // find trusts the offsets, so every bucket has to lie inside the entries
+        if (offsets[0] != 0 || offsets[header->buckets] != header->size)
+            throw std::runtime_error("the HashMap image is damaged");
+        for (size_t bucket = 0; bucket < header->buckets; ++bucket) {
+            if (offsets[bucket] > offsets[bucket + 1])
+                throw std::runtime_error("the HashMap image is damaged");
+        }
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    void HashMapView<KeyType, ValueType, Hash>::unmap() {
+        if (mapping != nullptr)
+            munmap(mapping, mapping_size);
+        mapping = nullptr;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    HashMapView<KeyType, ValueType, Hash>::HashMapView(const std::string &path, const Hash &_hasher)
+            : hasher(_hasher), mapping(nullptr), mapping_size(0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw std::runtime_error("can't open " + path);
+        struct stat info;
+        if (fstat(fd, &info) == -1 || info.st_size == 0) {
+            close(fd);
+            throw std::runtime_error("can't map " + path);
+        }
+        mapping_size = static_cast<size_t>(info.st_size);
+        mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping holds the file on its own
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            mapping = nullptr;
+            throw std::runtime_error("can't map " + path);
+        }
+        try {
+            attach(mapping, mapping_size);
+        } catch (...) {
+            unmap();
+            throw;
+        }
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    HashMapView<KeyType, ValueType, Hash>::HashMapView(HashMapView &&other) noexcept
+            : hasher(other.hasher), mapping(other.mapping), mapping_size(other.mapping_size),
+              header(other.header), offsets(other.offsets), entries(other.entries) {
+        other.mapping = nullptr;
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    typename HashMapView<KeyType, ValueType, Hash>::const_iterator
+    HashMapView<KeyType, ValueType, Hash>::find(const KeyType &key) const {
+        size_t bucket = bucket_index(hasher(key), header->buckets);
+        for (const value_type *it = entries + offsets[bucket]; it != entries + offsets[bucket + 1]; ++it) {
+            if (it->first == key)
+                return it;
+        }
+        return end();
+    }
+
+    template<class KeyType, class ValueType, class Hash>
+    const ValueType &
+    HashMapView<KeyType, ValueType, Hash>::at(const KeyType &key) const {
+        const_iterator it = find(key);
+        if (it == end())
+            throw std::out_of_range("");
+        return it->second;
+    }
+}
@@ -0,0 +1,344 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include "hash_map.h"
+
+namespace HashMap {
+    struct CacheStats {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+    };
+
+    // HashMap that holds at most capacity elements and evicts the least recently used one;
+    // the recency list is threaded through the elements themselves: the nodes of HashMap
+    // never move (rebuilds relink them), so the elements point at each other directly
+    template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class Policy = DefaultPolicy>
+    class LruCache {
+    private:
+        struct Node;
+        typedef std::pair<const KeyType, Node> slot_type;
+
+        struct Node {
+            ValueType value;
+            // towards the most and the least recently used element
+            slot_type *newer;
+            slot_type *older;
+
+            template<class V>
+            explicit Node(V &&_value)
+                    : value(std::forward<V>(_value)), newer(nullptr), older(nullptr) {}
+        };
+
+        typedef HashMap<KeyType, Node, Hash, Policy> map_type;
+
+        map_type map;
+        size_t limit;
+        slot_type *newest;
+        slot_type *oldest;
+        CacheStats counters;
+
+        void unlink(slot_type *);
+
+        void push_front(slot_type *);
+
+        void evict();
+
+    public:
+        // capacity has to be positive
+        explicit
+        LruCache(size_t capacity, const Hash &_hasher = Hash())
+                : map(_hasher), limit(capacity), newest(nullptr), oldest(nullptr), counters{0, 0, 0} {
+            if (capacity == 0)
+                throw std::invalid_argument("LruCache needs a positive capacity");
+            // put inserts before it evicts
+            map.reserve(capacity + 1);
+        }
+
+        LruCache(const LruCache &) = delete;
+
+        LruCache &operator=(const LruCache &) = delete;
+
+        // the nodes stay where they are, so the recency list moves along with the map;
+        // other is left an empty cache of the same capacity
+        LruCache(LruCache &&other)
+                : map(std::move(other.map)), limit(other.limit), newest(other.newest), oldest(other.oldest),
+                  counters(other.counters) {
+            other.newest = other.oldest = nullptr;
+            other.counters = CacheStats{0, 0, 0};
+        }
+
+        LruCache &operator=(LruCache &&);
+
+        size_t size() const {
+            return map.size();
+        }
+
+        bool empty() const {
+            return map.empty();
+        }
+
+        size_t capacity() const {
+            return limit;
+        }
+
+        CacheStats stats() const {
+            return counters;
+        }
+
+        // the value of key or nullptr, a hit makes key the most recently used
+        ValueType *get(const KeyType &);
+
+        // inserts or overwrites key and makes it the most recently used,
+        // evicts the least recently used element if the cache is full
+        template<class V>
+        void put(const KeyType &, V &&);
+
+        bool erase(const KeyType &);
+
+        void clear();
+    };
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    void LruCache<KeyType, ValueType, Hash, Policy>::unlink(slot_type *slot) {
+        Node &node = slot->second;
+        if (node.newer != nullptr)
+            node.newer->second.older = node.older;
+        else
+            newest = node.older;
+        if (node.older != nullptr)
+            node.older->second.newer = node.newer;
+        else
+            oldest = node.newer;
+        node.newer = node.older = nullptr;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    void LruCache<KeyType, ValueType, Hash, Policy>::push_front(slot_type *slot) {
+        slot->second.older = newest;
+        if (newest != nullptr)
+            newest->second.newer = slot;
+        else
+            oldest = slot;
+        newest = slot;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    void LruCache<KeyType, ValueType, Hash, Policy>::evict() {
+        slot_type *victim = oldest;
+        unlink(victim);
+        // erase finds the node by its own key and doesn't look at the key after freeing it
+        map.erase(victim->first);
+        ++counters.evictions;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    LruCache<KeyType, ValueType, Hash, Policy> &
+    LruCache<KeyType, ValueType, Hash, Policy>::operator=(LruCache &&other) {
+        if (this != &other) {
+            map = std::move(other.map);
+            limit = other.limit;
+            newest = other.newest;
+            oldest = other.oldest;
+            counters = other.counters;
+            other.newest = other.oldest = nullptr;
+            other.counters = CacheStats{0, 0, 0};
+        }
+        return *this;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    ValueType *LruCache<KeyType, ValueType, Hash, Policy>::get(const KeyType &key) {
+        auto it = map.find(key);
+        if (it == map.end()) {
+            ++counters.misses;
+            return nullptr;
+        }
+        ++counters.hits;
+        slot_type *slot = &*it;
+        if (slot != newest) {
+            unlink(slot);
+            push_front(slot);
+        }
+        return &slot->second.value;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    template<class V>
+    void LruCache<KeyType, ValueType, Hash, Policy>::put(const KeyType &key, V &&value) {
+        auto ret = map.try_emplace(key, std::forward<V>(value));
+        slot_type *slot = &*ret.first;
+        if (!ret.second) {
+            slot->second.value = std::forward<V>(value);
+            if (slot == newest)
+                return;
+            unlink(slot);
+        }
+        push_front(slot);
+        if (map.size() > limit)
+            evict();
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    bool LruCache<KeyType, ValueType, Hash, Policy>::erase(const KeyType &key) {
+        auto it = map.find(key);
+        if (it == map.end())
+            return false;
+        unlink(&*it);
+        map.erase(key);
+        return true;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    void LruCache<KeyType, ValueType, Hash, Policy>::clear() {
+        map.clear();
+        newest = oldest = nullptr;
+    }
+
+    // LruCache for many threads: the keys are spread over shards like in ConcurrentHashMap,
+    // every shard is an LruCache of its own capacity under its own lock,
+    // so eviction is least recently used within a shard
+    template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class Policy = DefaultPolicy>
+    class ShardedLruCache {
+    private:
+        typedef LruCache<KeyType, ValueType, Hash, Policy> cache_type;
+
+        // the padding keeps neighbouring shards off each other's cache lines,
+        // alignas(64) isn't honoured by container allocations before C++17
+        struct Shard {
+            mutable std::mutex mutex;
+            cache_type cache;
+            char padding[64];
+
+            Shard(size_t capacity, const Hash &_hasher)
+                    : cache(capacity, _hasher) {}
+        };
+
+        Hash hasher;
+        // a deque builds the shards in place, they can't be moved
+        std::deque<Shard> shards;
+
+        Shard &shard_of(const KeyType &key) {
+            return shards[shard_index(hasher(key), shards.size())];
+        }
+
+        static size_t round_up(size_t shards_number) {
+            size_t count = 1;
+            while (count < shards_number)
+                count *= 2;
+            return count;
+        }
+
+    public:
+        static constexpr size_t DefaultShards = 16;
+
+        // the number of shards is rounded up to a power of two and then halved while it exceeds capacity,
+        // capacity is split over them as evenly as possible
+        explicit
+        ShardedLruCache(size_t capacity, size_t shards_number = DefaultShards, const Hash &_hasher = Hash());
+
+        ShardedLruCache(const ShardedLruCache &) = delete;
+
+        ShardedLruCache &operator=(const ShardedLruCache &) = delete;
+
+        size_t size() const;
+
+        size_t capacity() const {
+            size_t total = 0;
+            for (const auto &shard : shards)
+                total += shard.cache.capacity();
+            return total;
+        }
+
+        // sums of the counters of all the shards
+        CacheStats stats() const;
+
+        // copies the value of key into value, false if key is not there
+        bool get(const KeyType &, ValueType &value);
+
+        template<class V>
+        void put(const KeyType &, V &&);
+
+        bool erase(const KeyType &);
+
+        void clear();
+    };
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    constexpr size_t ShardedLruCache<KeyType, ValueType, Hash, Policy>::DefaultShards;
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    ShardedLruCache<KeyType, ValueType, Hash, Policy>::ShardedLruCache(size_t capacity, size_t shards_number,
+                                                                       const Hash &_hasher)
+            : hasher(_hasher) {
+        size_t count = round_up(shards_number);
+        // every shard holds at least one element, so there are no more shards than capacity
+        while (count > 1 && count > capacity)
+            count /= 2;
+        // the first capacity % count shards take the remainder, the total is exactly capacity
+        for (size_t i = 0; i < count; ++i)
+            shards.emplace_back(capacity / count + (i < capacity % count ? 1 : 0), _hasher);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    size_t ShardedLruCache<KeyType, ValueType, Hash, Policy>::size() const {
+        size_t total = 0;
+        for (const auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.cache.size();
+        }
+        return total;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    CacheStats ShardedLruCache<KeyType, ValueType, Hash, Policy>::stats() const {
+        CacheStats total{0, 0, 0};
+        for (const auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            CacheStats part = shard.cache.stats();
+            total.hits += part.hits;
+            total.misses += part.misses;
+            total.evictions += part.evictions;
+        }
+        return total;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    bool ShardedLruCache<KeyType, ValueType, Hash, Policy>::get(const KeyType &key, ValueType &value) {
+        auto &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ValueType *found = shard.cache.get(key);
+        if (found == nullptr)
+            return false;
+        value = *found;
+        return true;
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    template<class V>
+    void ShardedLruCache<KeyType, ValueType, Hash, Policy>::put(const KeyType &key, V &&value) {
+        auto &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.cache.put(key, std::forward<V>(value));
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    bool ShardedLruCache<KeyType, ValueType, Hash, Policy>::erase(const KeyType &key) {
+        auto &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.cache.erase(key);
+    }
+
+    template<class KeyType, class ValueType, class Hash, class Policy>
+    void ShardedLruCache<KeyType, ValueType, Hash, Policy>::clear() {
+        for (auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.cache.clear();
+        }
+    }
+}
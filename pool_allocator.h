@@ -0,0 +1,154 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace NAlloc {
+    // arena that hands out small objects from big contiguous blocks
+    // freed objects go to per-size free lists and are reused,
+    // all blocks are released at once when the arena dies;
+    // alignments up to alignof(std::max_align_t) are supported
+    class Arena {
+    private:
+        static constexpr size_t Align = alignof(std::max_align_t);
+        static constexpr size_t BlockSize = 64 * 1024;
+        static constexpr size_t MaxPooledSize = 1024;
+
+        struct FreeCell {
+            FreeCell* next;
+        };
+
+        std::vector<void*> blocks_;
+        std::vector<FreeCell*> free_lists_;
+        char* cursor_;
+        char* block_end_;
+        size_t system_allocations_;
+
+        static size_t size_class(size_t bytes) {
+            return (bytes + Align - 1) / Align;
+        }
+
+    public:
+        Arena()
+            : free_lists_(MaxPooledSize / Align + 1, nullptr)
+            , cursor_(nullptr)
+            , block_end_(nullptr)
+            , system_allocations_(0) {
+        }
+
+        Arena(const Arena&) = delete;
+        Arena& operator= (const Arena&) = delete;
+
+        void* allocate(size_t bytes, size_t alignment) {
+            if (bytes > MaxPooledSize || alignment > Align) {
+                ++system_allocations_;
+                return ::operator new(bytes);
+            }
+            size_t cls = size_class(bytes);
+            if (free_lists_[cls] != nullptr) {
+                FreeCell* cell = free_lists_[cls];
+                free_lists_[cls] = cell->next;
+                return cell;
+            }
+            size_t rounded = cls * Align;
+            if (cursor_ == nullptr || static_cast<size_t>(block_end_ - cursor_) < rounded) {
+                blocks_.reserve(blocks_.size() + 1);
+                cursor_ = static_cast<char*>(::operator new(BlockSize));
+                block_end_ = cursor_ + BlockSize;
+                blocks_.push_back(cursor_);
+                ++system_allocations_;
+            }
+            void* ret = cursor_;
+            cursor_ += rounded;
+            return ret;
+        }
+
+        void deallocate(void* ptr, size_t bytes, size_t alignment) {
+            if (bytes > MaxPooledSize || alignment > Align) {
+                ::operator delete(ptr);
+                return;
+            }
+            size_t cls = size_class(bytes);
+            FreeCell* cell = static_cast<FreeCell*>(ptr);
+            cell->next = free_lists_[cls];
+            free_lists_[cls] = cell;
+        }
+
+        // how many times the arena went to the system allocator
+        size_t system_allocations() const {
+            return system_allocations_;
+        }
+
+        ~Arena() {
+            for (void* block : blocks_) {
+                ::operator delete(block);
+            }
+        }
+    };
+
+    // stateful allocator over a shared Arena
+    // copies (and rebound copies) share the arena and compare equal,
+    // copying a container gives the copy a fresh arena
+    template <typename T>
+    class PoolAllocator {
+    private:
+        // neither the blocks nor the system fallback align beyond std::max_align_t
+        static_assert(alignof(T) <= alignof(std::max_align_t), "PoolAllocator does not support over-aligned types");
+
+        template <typename U>
+        friend class PoolAllocator;
+
+        std::shared_ptr<Arena> arena_;
+
+    public:
+        typedef T value_type;
+        typedef std::false_type propagate_on_container_copy_assignment;
+        typedef std::true_type propagate_on_container_move_assignment;
+        typedef std::true_type propagate_on_container_swap;
+        typedef std::false_type is_always_equal;
+
+        PoolAllocator()
+            : arena_(std::make_shared<Arena>()) {
+        }
+
+        template <typename U>
+        PoolAllocator(const PoolAllocator<U>& other)
+            : arena_(other.arena_) {
+        }
+
+        T* allocate(size_t n) {
+            if (n != 1) {
+                return static_cast<T*>(::operator new(n * sizeof(T)));
+            }
+            return static_cast<T*>(arena_->allocate(sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* ptr, size_t n) {
+            if (n != 1) {
+                ::operator delete(ptr);
+                return;
+            }
+            arena_->deallocate(ptr, sizeof(T), alignof(T));
+        }
+
+        PoolAllocator select_on_container_copy_construction() const {
+            return PoolAllocator();
+        }
+
+        const Arena& arena() const {
+            return *arena_;
+        }
+
+        template <typename U>
+        bool operator== (const PoolAllocator<U>& other) const {
+            return arena_ == other.arena_;
+        }
+
+        template <typename U>
+        bool operator!= (const PoolAllocator<U>& other) const {
+            return arena_ != other.arena_;
+        }
+    };
+}
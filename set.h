@@ -1,17 +1,39 @@
 #pragma once
+#include <algorithm>
 #include <initializer_list>
 #include <iostream>
+#include <iterator>
 #include <list>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "pool_allocator.h"
 
 namespace NSet {
-    template <typename ValueType>
+    // Key can be looked up in a set of ValueType without making a ValueType
+    template <typename ValueType, typename Key, typename = void>
+    struct is_comparable_key : std::false_type {
+    };
+
+    template <typename ValueType, typename Key>
+    struct is_comparable_key<ValueType, Key,
+            decltype(void(std::declval<const Key&>() < std::declval<const ValueType&>()),
+                     void(std::declval<const ValueType&>() < std::declval<const Key&>()))> : std::true_type {
+    };
+
+    template <typename ValueType, typename Allocator = std::allocator<ValueType>>
     class Set {
     private:
-        typedef typename std::list<ValueType>::iterator set_iterator;
+        typedef std::list<ValueType, Allocator> list_type;
+        typedef typename list_type::iterator set_iterator;
         struct Node {
             set_iterator keys[4];
             Node* sons[4];
             size_t sons_number;
+            // number of elements in the subtree
+            size_t leaves;
             Node* parent;
 
             Node();
@@ -28,62 +50,214 @@ namespace NSet {
             void upd_keys();
             void remove_node();
         };
+        typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Node> node_allocator_type;
+        typedef std::allocator_traits<node_allocator_type> node_traits;
+
         Node* root_;
-        std::list<ValueType> elements_;
+        list_type elements_;
         size_t size_;
+        node_allocator_type node_allocator_;
+        // leaf of the last inserted element, hinted operations start from it
+        Node* finger_;
 
-        static Node* lower_bound(const ValueType& key, Node* root);
+        template <typename... Args>
+        Node* make_node(Args&&... args);
+        void free_node(Node* v);
+        template <typename... Args>
+        Node* reuse_node(std::vector<Node*>& spare, Args&&... args);
+
+        template <typename Key>
+        static Node* lower_bound(const Key& key, Node* root);
+        // lower_bound that climbs from the finger to the lowest ancestor holding the answer first,
+        // O(log d) for an answer d leaves away from the finger
+        Node* finger_search(const ValueType& key) const;
         void split_parent(Node* v);
+        // split_parent for the tree under root, new nodes are taken from spare first
+        void split_parent(Node* v, Node*& root, std::vector<Node*>& spare);
+
+        static set_iterator position_next_to(Node* neighbour, const ValueType& key);
+        // counts the leaf of key_it, about to become a son of v, in v and its ancestors;
+        // a maximum moves only while key_it is the largest element below
+        static void count_new_leaf(Node* v, set_iterator key_it);
+        // hangs a leaf for key_it next to the leaf neighbour,
+        // without update_keys the ancestors' keys and sizes are left for later
+        Node* link_leaf(Node* neighbour, set_iterator key_it, bool update_keys = true);
+        // unlinks the leaf and erases its element
+        void erase_leaf(Node* key_node);
+        // refreshes the keys and sizes above leaves linked without update_keys,
+        // the leaves have to be in order
+        void update_ancestors(std::vector<Node*>& leaves);
+        // moves the elements of the sorted and unique batch that are not here yet into the set,
+        // the rest stay in batch
+        void splice_sorted(list_type& batch);
+        // links key_it, which is already in elements_, as the only element or next to neighbour,
+        // the element is erased if that fails
+        void link_root(set_iterator key_it);
+        void link_or_erase(Node* neighbour, set_iterator key_it);
+        template <typename Arg>
+        set_iterator insert_value(Arg&& key);
 
         void dfs(Node* v);
 
+        static bool not_less(const ValueType& lhs, const ValueType& rhs);
+        // builds the tree bottom-up over elements_, they have to be sorted and unique,
+        // nodes from spare are used before allocating new ones
+        void build_tree(std::vector<Node*>& spare);
+        void build_tree();
+        // builds the tree again after elements_ were changed, reusing its nodes
+        void rebuild_tree();
+        void collect(Node* v, std::vector<Node*>& nodes);
+
+        // allocates count nodes into spare (all or none) and makes room for capacity
+        void reserve_nodes(std::vector<Node*>& spare, size_t count, size_t capacity);
+        static size_t height(Node* v);
+        // joins two trees, all of left less than all of right,
+        // a join takes at most |left_height - right_height| + 1 nodes from spare
+        Node* join_trees(Node* left, size_t left_height, Node* right, size_t right_height,
+                         size_t& joined_height, std::vector<Node*>& spare);
+        // cuts the tree along the path to key, elements less than key go to left
+        void split_tree(const ValueType& key, Node*& left, Node*& right, std::vector<Node*>& spare);
+        // all of other has to be greater than all of this, the allocators have to be equal
+        void append(Set& other);
+
+        enum class Algebra {
+            Union,
+            Intersection,
+            Difference,
+            SymmetricDifference
+        };
+
+        static Set combine(const Set& lhs, const Set& rhs, Algebra op);
+        void combine_with(const Set& other, Algebra op);
+
     public:
-        Set();
+        typedef Allocator allocator_type;
+
+        explicit
+        Set(const Allocator& alloc = Allocator());
 
         template <typename InputIterator>
-        Set(InputIterator begin, InputIterator end);
-        Set(std::initializer_list<ValueType> init_list);
+        Set(InputIterator begin, InputIterator end, const Allocator& alloc = Allocator());
+        Set(std::initializer_list<ValueType> init_list, const Allocator& alloc = Allocator());
         Set(const Set& other);
+        Set(Set&& other) noexcept;
 
         void swap(Set& other);
         Set& operator= (const Set& other);
+        Set& operator= (Set&& other) noexcept;
+
+        allocator_type get_allocator() const;
 
         size_t size() const;
         bool empty() const;
 
         void insert(const ValueType& x);
+        void insert(ValueType&& x);
         void erase(const ValueType& x);
 
-        typedef typename std::list<ValueType>::const_iterator iterator;
+        typedef typename list_type::const_iterator iterator;
+
+    private:
+        template <typename Key>
+        iterator find_key(const Key& key) const;
+        template <typename Key>
+        iterator lower_bound_key(const Key& key) const;
+
+    public:
+        // hint is the element the new one should go right before,
+        // returns the element equal to key
+        iterator insert(iterator hint, const ValueType& key);
+        // returns the element after the erased one
+        iterator erase(iterator pos);
+
+        // builds the element in place, it is thrown away if an equal one is there
+        template <typename... Args>
+        std::pair<iterator, bool> emplace(Args&&... args);
+
+        // sorts the batch once and applies it in one left-to-right sweep
+        template <typename InputIterator>
+        void insert_batch(InputIterator begin, InputIterator end);
+        template <typename InputIterator>
+        void erase_batch(InputIterator begin, InputIterator end);
 
         iterator begin() const;
         iterator end() const;
 
         iterator find(const ValueType& key) const;
+        template <typename Key, typename = typename std::enable_if<is_comparable_key<ValueType, Key>::value>::type>
+        iterator find(const Key& key) const;
 
         iterator lower_bound(const ValueType& key) const;
+        template <typename Key, typename = typename std::enable_if<is_comparable_key<ValueType, Key>::value>::type>
+        iterator lower_bound(const Key& key) const;
+
+        // k-th smallest element (from 0), end() if there are not enough elements
+        iterator nth(size_t k) const;
+        // number of elements less than key
+        size_t rank(const ValueType& key) const;
+        // number of elements in [lo, hi)
+        size_t count_range(const ValueType& lo, const ValueType& hi) const;
+
+        // in-place set algebra, O(size() + other.size())
+        void union_with(const Set& other);
+        void intersect_with(const Set& other);
+        void difference_with(const Set& other);
+        void symmetric_difference_with(const Set& other);
+
+        friend Set set_union(const Set& lhs, const Set& rhs) {
+            return combine(lhs, rhs, Algebra::Union);
+        }
+
+        friend Set set_intersection(const Set& lhs, const Set& rhs) {
+            return combine(lhs, rhs, Algebra::Intersection);
+        }
+
+        friend Set set_difference(const Set& lhs, const Set& rhs) {
+            return combine(lhs, rhs, Algebra::Difference);
+        }
+
+        friend Set set_symmetric_difference(const Set& lhs, const Set& rhs) {
+            return combine(lhs, rhs, Algebra::SymmetricDifference);
+        }
+
+        // moves the elements not less than key into the returned set,
+        // O(log n) for the tree plus the shorter of the two parts for the list
+        Set split(const ValueType& key);
+        // moves the elements of other that are not here yet, equal ones stay in other;
+        // O(log n) if one set lies entirely before the other and the allocators are equal,
+        // otherwise the list cells are spliced (or copied) over in one pass
+        void merge(Set& other);
+
+        // all of left should be less than all of right, otherwise it works as merge
+        friend Set join(Set&& left, Set&& right) {
+            left.merge(right);
+            return std::move(left);
+        }
 
         ~Set();
     };
 }
 
-template <typename ValueType>
-NSet::Set<ValueType>::Node::Node()
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>::Node::Node()
     : sons_number(0)
+    , leaves(0)
     , parent(nullptr) {
 }
 
-template <typename ValueType>
-NSet::Set<ValueType>::Node::Node(set_iterator key)
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>::Node::Node(set_iterator key)
     : Node() {
     sons_number = 1;
+    leaves = 1;
     keys[0] = key;
 }
 
-template <typename ValueType>
-NSet::Set<ValueType>::Node::Node(const Node& other)
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>::Node::Node(const Node& other)
     : Node() {
     sons_number = other.sons_number;
+    leaves = other.leaves;
     parent = other.parent;
     for (size_t i = 0; i != sons_number; ++i) {
         keys[i] = other.keys[i];
@@ -91,8 +265,8 @@ NSet::Set<ValueType>::Node::Node(const Node& other)
     }
 }
 
-template <typename ValueType>
-void NSet::Set<ValueType>::Node::sort_sons() {
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::Node::sort_sons() {
     for (size_t i = 0; i != sons_number; ++i) {
         for (size_t j = 1; j != sons_number; ++j) {
             if (sons[j - 1]->sons_number == 0 || (sons[j]->sons_number != 0 && *keys[j] < *keys[j - 1])) {
@@ -103,9 +277,11 @@ void NSet::Set<ValueType>::Node::sort_sons() {
     }
 }
 
-template <typename ValueType>
-void NSet::Set<ValueType>::Node::upd_key() {
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::Node::upd_key() {
+    leaves = 0;
     for (size_t i = 0; i != sons_number; ++i) {
+        leaves += sons[i]->leaves;
         if (sons[i]->sons_number != 0) {
             size_t j = sons[i]->sons_number - 1;
             if (j > 0) {
@@ -118,8 +294,8 @@ void NSet::Set<ValueType>::Node::upd_key() {
     }
 }
 
-template <typename ValueType>
-void NSet::Set<ValueType>::Node::upd_keys() {
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::Node::upd_keys() {
     Node* v = parent;
     while (v != nullptr) {
         v->upd_key();
@@ -127,12 +303,18 @@ void NSet::Set<ValueType>::Node::upd_keys() {
     }
 }
 
-template <typename ValueType>
-void NSet::Set<ValueType>::split_parent(Node* v) {
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::split_parent(Node* v) {
+    std::vector<Node*> spare;
+    split_parent(v, root_, spare);
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::split_parent(Node* v, Node*& root, std::vector<Node*>& spare) {
     if (v->sons_number != 4) {
         return;
     }
-    Node* split_v = new Node();
+    Node* split_v = reuse_node(spare);
     split_v->sons[0] = v->sons[2];
     split_v->sons[1] = v->sons[3];
     split_v->keys[0] = v->keys[2];
@@ -140,27 +322,29 @@ void NSet::Set<ValueType>::split_parent(Node* v) {
     split_v->parent = v->parent;
     v->sons[2]->parent = v->sons[3]->parent = split_v;
     v->sons_number = split_v->sons_number = 2;
+    v->upd_key();
+    split_v->upd_key();
 
     if (v->parent == nullptr) {
-        Node* new_root = new Node();
+        Node* new_root = reuse_node(spare);
         new_root->sons[0] = v;
         new_root->sons[1] = split_v;
         v->parent = split_v->parent = new_root;
         new_root->sons_number = 2;
         new_root->upd_key();
         new_root->sort_sons();
-        root_ = new_root;
+        root = new_root;
     } else {
         v->parent->sons[v->parent->sons_number] = split_v;
         ++v->parent->sons_number;
         v->parent->upd_key();
         v->parent->sort_sons();
-        split_parent(v->parent);
+        split_parent(v->parent, root, spare);
     }
 }
 
-template <typename ValueType>
-void NSet::Set<ValueType>::Node::remove_node() {
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::Node::remove_node() {
     for (size_t i = 0; i != parent->sons_number; ++i) {
         if (parent->sons[i] == this) {
             for (size_t j = i + 1; j != parent->sons_number; ++j) {
@@ -169,108 +353,266 @@ void NSet::Set<ValueType>::Node::remove_node() {
             }
             --parent->sons_number;
             upd_keys();
-            delete parent->sons[parent->sons_number];
             break;
         }
     }
 }
 
-template <typename ValueType>
-NSet::Set<ValueType>::Set()
+template <typename ValueType, typename Allocator>
+template <typename... Args>
+typename NSet::Set<ValueType, Allocator>::Node*
+NSet::Set<ValueType, Allocator>::make_node(Args&&... args) {
+    Node* v = node_traits::allocate(node_allocator_, 1);
+    node_traits::construct(node_allocator_, v, std::forward<Args>(args)...);
+    return v;
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::free_node(Node* v) {
+    node_traits::destroy(node_allocator_, v);
+    node_traits::deallocate(node_allocator_, v, 1);
+}
+
+template <typename ValueType, typename Allocator>
+template <typename... Args>
+typename NSet::Set<ValueType, Allocator>::Node*
+NSet::Set<ValueType, Allocator>::reuse_node(std::vector<Node*>& spare, Args&&... args) {
+    if (spare.empty()) {
+        return make_node(std::forward<Args>(args)...);
+    }
+    Node* v = spare.back();
+    spare.pop_back();
+    node_traits::destroy(node_allocator_, v);
+    node_traits::construct(node_allocator_, v, std::forward<Args>(args)...);
+    return v;
+}
+
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>::Set(const Allocator& alloc)
     : root_(nullptr)
-    , size_(0) {
+    , elements_(alloc)
+    , size_(0)
+    , node_allocator_(alloc)
+    , finger_(nullptr) {
 }
 
-template <typename ValueType>
+template <typename ValueType, typename Allocator>
 template <typename InputIterator>
-NSet::Set<ValueType>::Set(InputIterator begin, InputIterator end)
-    : root_(nullptr)
-    , size_(0) {
-    while (begin != end) {
+NSet::Set<ValueType, Allocator>::Set(InputIterator begin, InputIterator end, const Allocator& alloc)
+    : Set(alloc) {
+    elements_.insert(elements_.end(), begin, end);
+    if (std::adjacent_find(elements_.begin(), elements_.end(), not_less) != elements_.end()) {
+        elements_.sort();
+        elements_.unique(not_less);
+    }
+    build_tree();
+}
+
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>::Set(std::initializer_list<ValueType> init_list, const Allocator& alloc)
+    : Set(init_list.begin(), init_list.end(), alloc) {
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::dfs(Node* v) {
+    if (v->sons_number == 2 || v->sons_number == 3) {
+        for (size_t i = 0; i != v->sons_number; ++i) {
+            dfs(v->sons[i]);
+        }
+    }
+    free_node(v);
+}
+
+template <typename ValueType, typename Allocator>
+bool NSet::Set<ValueType, Allocator>::not_less(const ValueType& lhs, const ValueType& rhs) {
+    return !(lhs < rhs);
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::build_tree(std::vector<Node*>& spare) {
+    finger_ = nullptr;
+    if (elements_.empty()) {
+        for (Node* v : spare) {
+            free_node(v);
+        }
+        spare.clear();
+        return;
+    }
+    std::vector<Node*> level;
+    try {
+        level.reserve(elements_.size());
+        for (set_iterator it = elements_.begin(); it != elements_.end(); ++it) {
+            level.push_back(reuse_node(spare, it));
+        }
+    } catch (...) {
+        for (Node* v : level) {
+            free_node(v);
+        }
+        for (Node* v : spare) {
+            free_node(v);
+        }
+        spare.clear();
+        throw;
+    }
+
+    while (level.size() != 1) {
+        std::vector<Node*> next;
+        size_t i = 0;
         try {
-            insert(*(begin)++);
+            next.reserve(level.size() / 2);
+            while (i != level.size()) {
+                // groups of three, the tail is split as 2, 3 or 2 + 2
+                size_t rest = level.size() - i;
+                size_t sons_number = (rest == 2 || rest == 4) ? 2 : 3;
+                Node* v = reuse_node(spare);
+                for (size_t j = 0; j != sons_number; ++j) {
+                    v->sons[j] = level[i + j];
+                    level[i + j]->parent = v;
+                }
+                v->sons_number = sons_number;
+                v->upd_key();
+                next.push_back(v);
+                i += sons_number;
+            }
         } catch (...) {
-            if (size_ != 0) {
-                dfs(root_);
+            for (Node* v : next) {
+                dfs(v);
+            }
+            for (; i != level.size(); ++i) {
+                dfs(level[i]);
             }
+            for (Node* v : spare) {
+                free_node(v);
+            }
+            spare.clear();
             throw;
         }
+        level.swap(next);
+    }
+    for (Node* v : spare) {
+        free_node(v);
     }
+    spare.clear();
+    root_ = level[0];
+    size_ = elements_.size();
 }
 
-template <typename ValueType>
-NSet::Set<ValueType>::Set(std::initializer_list<ValueType> init_list)
-    : Set(init_list.begin(), init_list.end()) {
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::build_tree() {
+    std::vector<Node*> spare;
+    build_tree(spare);
 }
 
-template <typename ValueType>
-void NSet::Set<ValueType>::dfs(Node* v) {
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::collect(Node* v, std::vector<Node*>& nodes) {
     if (v->sons_number == 2 || v->sons_number == 3) {
         for (size_t i = 0; i != v->sons_number; ++i) {
-            dfs(v->sons[i]);
+            collect(v->sons[i], nodes);
         }
     }
-    delete v;
+    nodes.push_back(v);
 }
 
-template <typename ValueType>
-NSet::Set<ValueType>::Set(const Set& other)
-    : Set(other.begin(), other.end()) {
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::rebuild_tree() {
+    std::vector<Node*> spare;
+    if (root_ != nullptr) {
+        try {
+            // a 2-3 tree over n leaves has less than 2n nodes
+            spare.reserve(2 * size_);
+            collect(root_, spare);
+        } catch (...) {
+            spare.clear();
+            dfs(root_);
+        }
+    }
+    root_ = nullptr;
+    size_ = 0;
+    try {
+        build_tree(spare);
+    } catch (...) {
+        elements_.clear();
+        throw;
+    }
+}
+
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>::Set(const Set& other)
+    : Set(std::allocator_traits<Allocator>::select_on_container_copy_construction(other.get_allocator())) {
+    elements_.insert(elements_.end(), other.begin(), other.end());
+    build_tree();
+}
+
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>::Set(Set&& other) noexcept
+    : Set(other.get_allocator()) {
+    swap(other);
 }
 
-template <typename ValueType>
-void NSet::Set<ValueType>::swap(Set& other) {
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::swap(Set& other) {
     std::swap(root_, other.root_);
     std::swap(size_, other.size_);
     std::swap(elements_, other.elements_);
+    std::swap(node_allocator_, other.node_allocator_);
+    std::swap(finger_, other.finger_);
 }
 
-template <typename ValueType>
-NSet::Set<ValueType>& NSet::Set<ValueType>::operator= (const NSet::Set<ValueType>& other) {
-    Set<ValueType> tmp(other);
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>& NSet::Set<ValueType, Allocator>::operator= (const NSet::Set<ValueType, Allocator>& other) {
+    Set<ValueType, Allocator> tmp(other);
     swap(tmp);
     return *this;
 }
 
-template <typename ValueType>
-size_t NSet::Set<ValueType>::size() const {
-    return size_;
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>& NSet::Set<ValueType, Allocator>::operator= (Set&& other) noexcept {
+    Set<ValueType, Allocator> tmp(std::move(other));
+    swap(tmp);
+    return *this;
 }
 
-template <typename ValueType>
-bool NSet::Set<ValueType>::empty() const {
-    return size_ == 0;
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::allocator_type
+NSet::Set<ValueType, Allocator>::get_allocator() const {
+    return elements_.get_allocator();
 }
 
-template <typename ValueType>
-void NSet::Set<ValueType>::insert(const ValueType& key) {
-    if (size_ == 0) {
-        elements_.push_back(key);
-        root_ = new Node(elements_.begin());
-        ++size_;
-        return;
-    }
-
-    Node* neighbour_key = lower_bound(key, root_);
-    if (!(*neighbour_key->keys[0] < key) && !(key < *neighbour_key->keys[0])) {
-        return;
-    }
+template <typename ValueType, typename Allocator>
+size_t NSet::Set<ValueType, Allocator>::size() const {
+    return size_;
+}
 
-    set_iterator key_it;
+template <typename ValueType, typename Allocator>
+bool NSet::Set<ValueType, Allocator>::empty() const {
+    return size_ == 0;
+}
 
-    if (key < *neighbour_key->keys[0]) {
-        key_it = elements_.insert(neighbour_key->keys[0], key);
-    } else {
-        key_it = neighbour_key->keys[0];
-        ++key_it;
-        key_it = elements_.insert(key_it, key);
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::set_iterator
+NSet::Set<ValueType, Allocator>::position_next_to(Node* neighbour, const ValueType& key) {
+    set_iterator pos = neighbour->keys[0];
+    if (*pos < key) {
+        ++pos;
     }
+    return pos;
+}
 
-    Node* new_node = new Node(key_it);
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::Node*
+NSet::Set<ValueType, Allocator>::link_leaf(Node* neighbour, set_iterator key_it, bool update_keys) {
+    Node* new_node = make_node(key_it);
     ++size_;
 
-    if (neighbour_key->parent == nullptr) {
-        Node* tmp = new Node();
+    if (neighbour->parent == nullptr) {
+        Node* tmp;
+        try {
+            tmp = make_node();
+        } catch (...) {
+            free_node(new_node);
+            --size_;
+            throw;
+        }
         std::swap(root_, tmp);
         root_->sons[0] = tmp;
         root_->sons[1] = new_node;
@@ -279,7 +621,11 @@ void NSet::Set<ValueType>::insert(const ValueType& key) {
         root_->upd_key();
         root_->sort_sons();
     } else {
-        Node* par = neighbour_key->parent;
+        Node* par = neighbour->parent;
+        if (update_keys) {
+            // the nodes that split are counted again from their sons below, the rest are only fixed up
+            count_new_leaf(par, key_it);
+        }
         par->sons[par->sons_number] = new_node;
         ++par->sons_number;
         new_node->parent = par;
@@ -287,11 +633,243 @@ void NSet::Set<ValueType>::insert(const ValueType& key) {
         par->sort_sons();
         split_parent(par);
     }
-    new_node->upd_keys();
+    finger_ = new_node;
+    return new_node;
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::count_new_leaf(Node* v, set_iterator key_it) {
+    bool is_max = *v->keys[v->sons_number - 1] < *key_it;
+    ++v->leaves;
+    while (v->parent != nullptr) {
+        Node* par = v->parent;
+        size_t i = 0;
+        while (par->sons[i] != v) {
+            ++i;
+        }
+        ++par->leaves;
+        if (is_max) {
+            par->keys[i] = key_it;
+            is_max = i == par->sons_number - 1;
+        }
+        v = par;
+    }
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::link_root(set_iterator key_it) {
+    try {
+        root_ = finger_ = make_node(key_it);
+    } catch (...) {
+        elements_.erase(key_it);
+        throw;
+    }
+    ++size_;
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::link_or_erase(Node* neighbour, set_iterator key_it) {
+    try {
+        link_leaf(neighbour, key_it);
+    } catch (...) {
+        elements_.erase(key_it);
+        throw;
+    }
+}
+
+template <typename ValueType, typename Allocator>
+template <typename Arg>
+typename NSet::Set<ValueType, Allocator>::set_iterator
+NSet::Set<ValueType, Allocator>::insert_value(Arg&& key) {
+    if (size_ == 0) {
+        elements_.push_back(std::forward<Arg>(key));
+        link_root(elements_.begin());
+        return elements_.begin();
+    }
+
+    Node* neighbour_key = lower_bound(key, root_);
+    if (!(*neighbour_key->keys[0] < key) && !(key < *neighbour_key->keys[0])) {
+        return neighbour_key->keys[0];
+    }
+
+    set_iterator key_it = elements_.insert(position_next_to(neighbour_key, key), std::forward<Arg>(key));
+    link_or_erase(neighbour_key, key_it);
+    return key_it;
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::insert(const ValueType& key) {
+    insert_value(key);
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::insert(ValueType&& key) {
+    insert_value(std::move(key));
+}
+
+template <typename ValueType, typename Allocator>
+template <typename... Args>
+std::pair<typename NSet::Set<ValueType, Allocator>::iterator, bool>
+NSet::Set<ValueType, Allocator>::emplace(Args&&... args) {
+    // the new element waits in a cell of its own and is spliced in if it is new
+    list_type cell(elements_.get_allocator());
+    cell.emplace_back(std::forward<Args>(args)...);
+    set_iterator key_it = cell.begin();
+    if (size_ == 0) {
+        elements_.splice(elements_.end(), cell);
+        link_root(key_it);
+        return std::make_pair(iterator(key_it), true);
+    }
+
+    Node* neighbour_key = lower_bound(*key_it, root_);
+    if (!(*neighbour_key->keys[0] < *key_it) && !(*key_it < *neighbour_key->keys[0])) {
+        return std::make_pair(iterator(neighbour_key->keys[0]), false);
+    }
+    elements_.splice(position_next_to(neighbour_key, *key_it), cell, key_it);
+    link_or_erase(neighbour_key, key_it);
+    return std::make_pair(iterator(key_it), true);
+}
+
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::insert(iterator hint, const ValueType& key) {
+    if (hint != end() && !(key < *hint) && !(*hint < key)) {
+        return hint;
+    }
+    bool fits_after = hint == begin() || *std::prev(hint) < key;
+    bool fits_before = hint == end() || key < *hint;
+    if (finger_ == nullptr || !fits_after || !fits_before) {
+        return insert_value(key);
+    }
+    // the leaf of hint or of the element before it is a neighbour, the finger often is one of them
+    Node* neighbour_key;
+    if (hint != end() && iterator(finger_->keys[0]) == hint) {
+        neighbour_key = finger_;
+    } else if (hint != begin() && iterator(finger_->keys[0]) == std::prev(hint)) {
+        neighbour_key = finger_;
+    } else {
+        neighbour_key = finger_search(key);
+    }
+
+    set_iterator key_it = elements_.insert(position_next_to(neighbour_key, key), key);
+    link_or_erase(neighbour_key, key_it);
+    return key_it;
+}
+
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::Node*
+NSet::Set<ValueType, Allocator>::finger_search(const ValueType& key) const {
+    Node* v = finger_;
+    if (*v->keys[0] < key) {
+        // everything under v is at least the finger, so once the maximum
+        // of v reaches key the answer is under v
+        while (v->parent != nullptr && *v->keys[v->sons_number == 1 ? 0 : v->sons_number - 1] < key) {
+            v = v->parent;
+        }
+        return lower_bound(key, v);
+    }
+    // the maximum of v is at least key, so once the maximum of the left brother
+    // of v is less than key the answer is under v
+    while (v->parent != nullptr) {
+        Node* par = v->parent;
+        size_t i = 0;
+        while (par->sons[i] != v) {
+            ++i;
+        }
+        if (i != 0 && *par->keys[i - 1] < key) {
+            break;
+        }
+        v = par;
+    }
+    return lower_bound(key, v);
+}
+
+template <typename ValueType, typename Allocator>
+template <typename InputIterator>
+void NSet::Set<ValueType, Allocator>::insert_batch(InputIterator begin, InputIterator end) {
+    list_type batch(elements_.get_allocator());
+    batch.insert(batch.end(), begin, end);
+    batch.sort();
+    batch.unique(not_less);
+    splice_sorted(batch);
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::splice_sorted(list_type& batch) {
+    if (batch.empty()) {
+        return;
+    }
+
+    if (4 * batch.size() >= size_) {
+        // big batch, merge the lists and build the tree again
+        set_iterator it = elements_.begin();
+        set_iterator cur = batch.begin();
+        while (cur != batch.end()) {
+            while (it != elements_.end() && *it < *cur) {
+                ++it;
+            }
+            if (it != elements_.end() && !(*cur < *it)) {
+                ++cur;
+            } else {
+                elements_.splice(it, batch, cur++);
+            }
+        }
+        rebuild_tree();
+        return;
+    }
+
+    // the keys only grow, so stale maximums on the way up still lead the right way,
+    // the keys and sizes of all touched ancestors are fixed after the sweep
+    std::vector<Node*> touched;
+    touched.reserve(batch.size());
+    try {
+        set_iterator cur = batch.begin();
+        while (cur != batch.end()) {
+            const ValueType& key = *cur;
+            Node* neighbour_key;
+            if (finger_ != nullptr && *finger_->keys[0] < key) {
+                neighbour_key = finger_search(key);
+            } else {
+                neighbour_key = lower_bound(key, root_);
+            }
+            if (!(*neighbour_key->keys[0] < key) && !(key < *neighbour_key->keys[0])) {
+                ++cur;
+                continue;
+            }
+            set_iterator key_it = cur++;
+            elements_.splice(position_next_to(neighbour_key, key), batch, key_it);
+            try {
+                touched.push_back(link_leaf(neighbour_key, key_it, false));
+            } catch (...) {
+                elements_.erase(key_it);
+                throw;
+            }
+        }
+    } catch (...) {
+        update_ancestors(touched);
+        throw;
+    }
+    update_ancestors(touched);
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::update_ancestors(std::vector<Node*>& leaves) {
+    // all leaves are at the same depth, so the parents on every level come ordered too
+    while (!leaves.empty() && leaves[0]->parent != nullptr) {
+        size_t next_size = 0;
+        for (size_t i = 0; i != leaves.size(); ++i) {
+            Node* par = leaves[i]->parent;
+            if (next_size == 0 || leaves[next_size - 1] != par) {
+                leaves[next_size++] = par;
+                par->upd_key();
+            }
+        }
+        leaves.resize(next_size);
+    }
 }
 
-template <typename ValueType>
-void NSet::Set<ValueType>::erase(const ValueType& key) {
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::erase(const ValueType& key) {
     if (size_ == 0) {
         return;
     }
@@ -302,17 +880,73 @@ void NSet::Set<ValueType>::erase(const ValueType& key) {
         return;
     }
 
+    erase_leaf(key_node);
+}
+
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::erase(iterator pos) {
+    if (pos == end()) {
+        return end();
+    }
+    Node* key_node;
+    if (finger_ == nullptr) {
+        key_node = lower_bound(*pos, root_);
+    } else if (iterator(finger_->keys[0]) == pos) {
+        key_node = finger_;
+    } else {
+        key_node = finger_search(*pos);
+    }
+    iterator next = std::next(pos);
+    erase_leaf(key_node);
+    return next;
+}
+
+template <typename ValueType, typename Allocator>
+template <typename InputIterator>
+void NSet::Set<ValueType, Allocator>::erase_batch(InputIterator begin, InputIterator end) {
+    std::vector<ValueType> batch(begin, end);
+    std::sort(batch.begin(), batch.end());
+    batch.erase(std::unique(batch.begin(), batch.end(), not_less), batch.end());
+
+    if (4 * batch.size() < size_) {
+        for (const ValueType& key : batch) {
+            erase(key);
+        }
+        return;
+    }
+
+    // big batch, one pass over the list and the tree is built again
+    set_iterator it = elements_.begin();
+    for (const ValueType& key : batch) {
+        while (it != elements_.end() && *it < key) {
+            ++it;
+        }
+        if (it != elements_.end() && !(key < *it)) {
+            it = elements_.erase(it);
+        }
+    }
+    rebuild_tree();
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::erase_leaf(Node* key_node) {
+    if (key_node == finger_) {
+        finger_ = nullptr;
+    }
     --size_;
     elements_.erase(key_node->keys[0]);
     --key_node->sons_number;
+    key_node->leaves = 0;
 
     while (true) {
         if (key_node->parent == nullptr) {
-            delete root_;
+            free_node(root_);
             root_ = nullptr;
             break;
         } else if (key_node->parent->sons_number == 3) {
             key_node->remove_node();
+            free_node(key_node);
             break;
         } else {
             Node* par = key_node->parent;
@@ -323,13 +957,13 @@ void NSet::Set<ValueType>::erase(const ValueType& key) {
             } else {
                 bro = par->sons[0];
             }
-            delete key_node;
+            free_node(key_node);
             key_node = par->sons[0] = par->sons[1] = nullptr;
             par->sons_number = 0;
 
             Node* gpar = par->parent;
             if (gpar == nullptr) {
-                delete par;
+                free_node(par);
                 par = nullptr;
                 root_ = bro;
                 root_->parent = nullptr;
@@ -359,31 +993,46 @@ void NSet::Set<ValueType>::erase(const ValueType& key) {
     }
 }
 
-template <typename ValueType>
-typename NSet::Set<ValueType>::iterator
-NSet::Set<ValueType>::begin() const {
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::begin() const {
     return elements_.cbegin();
 }
 
-template <typename ValueType>
-typename NSet::Set<ValueType>::iterator
-NSet::Set<ValueType>::end() const {
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::end() const {
     return elements_.cend();
 }
 
-template <typename ValueType>
-typename NSet::Set<ValueType>::iterator
-NSet::Set<ValueType>::find(const ValueType& key) const {
-    typename NSet::Set<ValueType>::iterator it = lower_bound(key);
+template <typename ValueType, typename Allocator>
+template <typename Key>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::find_key(const Key& key) const {
+    typename NSet::Set<ValueType, Allocator>::iterator it = lower_bound_key(key);
     if (it != end() && !(key < *it) && !(*it < key)) {
         return it;
     }
     return end();
 }
 
-template <typename ValueType>
-typename NSet::Set<ValueType>::Node*
-NSet::Set<ValueType>::lower_bound(const ValueType& key, Node* root) {
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::find(const ValueType& key) const {
+    return find_key(key);
+}
+
+template <typename ValueType, typename Allocator>
+template <typename Key, typename>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::find(const Key& key) const {
+    return find_key(key);
+}
+
+template <typename ValueType, typename Allocator>
+template <typename Key>
+typename NSet::Set<ValueType, Allocator>::Node*
+NSet::Set<ValueType, Allocator>::lower_bound(const Key& key, Node* root) {
     if (root == nullptr) {
         return nullptr;
     }
@@ -408,9 +1057,10 @@ NSet::Set<ValueType>::lower_bound(const ValueType& key, Node* root) {
     return t;
 }
 
-template <typename ValueType>
-typename NSet::Set<ValueType>::iterator
-NSet::Set<ValueType>::lower_bound(const ValueType& key) const {
+template <typename ValueType, typename Allocator>
+template <typename Key>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::lower_bound_key(const Key& key) const {
     Node* t = lower_bound(key, root_);
     if (t == nullptr) {
         return end();
@@ -420,10 +1070,417 @@ NSet::Set<ValueType>::lower_bound(const ValueType& key) const {
     return end();
 }
 
-template <typename ValueType>
-NSet::Set<ValueType>::~Set() {
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::lower_bound(const ValueType& key) const {
+    return lower_bound_key(key);
+}
+
+template <typename ValueType, typename Allocator>
+template <typename Key, typename>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::lower_bound(const Key& key) const {
+    return lower_bound_key(key);
+}
+
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::iterator
+NSet::Set<ValueType, Allocator>::nth(size_t k) const {
+    if (k >= size_) {
+        return end();
+    }
+    Node* t = root_;
+    while (t->sons_number != 1) {
+        size_t i = 0;
+        while (k >= t->sons[i]->leaves) {
+            k -= t->sons[i]->leaves;
+            ++i;
+        }
+        t = t->sons[i];
+    }
+    return t->keys[0];
+}
+
+template <typename ValueType, typename Allocator>
+size_t NSet::Set<ValueType, Allocator>::rank(const ValueType& key) const {
+    if (root_ == nullptr) {
+        return 0;
+    }
+    size_t less = 0;
+    Node* t = root_;
+    while (t->sons_number != 1) {
+        size_t i = 0;
+        while (i + 1 != t->sons_number && *t->keys[i] < key) {
+            less += t->sons[i]->leaves;
+            ++i;
+        }
+        t = t->sons[i];
+    }
+    if (*t->keys[0] < key) {
+        ++less;
+    }
+    return less;
+}
+
+template <typename ValueType, typename Allocator>
+size_t NSet::Set<ValueType, Allocator>::count_range(const ValueType& lo, const ValueType& hi) const {
+    if (!(lo < hi)) {
+        return 0;
+    }
+    return rank(hi) - rank(lo);
+}
+
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>
+NSet::Set<ValueType, Allocator>::combine(const Set& lhs, const Set& rhs, Algebra op) {
+    Set result(std::allocator_traits<Allocator>::select_on_container_copy_construction(lhs.get_allocator()));
+    auto out = std::back_inserter(result.elements_);
+    switch (op) {
+        case Algebra::Union:
+            std::set_union(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), out);
+            break;
+        case Algebra::Intersection:
+            std::set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), out);
+            break;
+        case Algebra::Difference:
+            std::set_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), out);
+            break;
+        case Algebra::SymmetricDifference:
+            std::set_symmetric_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), out);
+            break;
+    }
+    result.build_tree();
+    return result;
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::combine_with(const Set& other, Algebra op) {
+    if (&other == this) {
+        if (op == Algebra::Difference || op == Algebra::SymmetricDifference) {
+            elements_.clear();
+            rebuild_tree();
+        }
+        return;
+    }
+    bool keep_own = op != Algebra::Intersection;
+    bool keep_common = op == Algebra::Union || op == Algebra::Intersection;
+    bool take_other = op == Algebra::Union || op == Algebra::SymmetricDifference;
+
+    try {
+        set_iterator it = elements_.begin();
+        iterator jt = other.begin();
+        while (it != elements_.end() && jt != other.end()) {
+            if (*it < *jt) {
+                it = keep_own ? std::next(it) : elements_.erase(it);
+            } else if (*jt < *it) {
+                if (take_other) {
+                    elements_.insert(it, *jt);
+                }
+                ++jt;
+            } else {
+                it = keep_common ? std::next(it) : elements_.erase(it);
+                ++jt;
+            }
+        }
+        if (!keep_own) {
+            elements_.erase(it, elements_.end());
+        }
+        if (take_other) {
+            elements_.insert(elements_.end(), jt, other.end());
+        }
+    } catch (...) {
+        // elements_ are still sorted, only the tree is behind
+        rebuild_tree();
+        throw;
+    }
+    rebuild_tree();
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::union_with(const Set& other) {
+    combine_with(other, Algebra::Union);
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::intersect_with(const Set& other) {
+    combine_with(other, Algebra::Intersection);
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::difference_with(const Set& other) {
+    combine_with(other, Algebra::Difference);
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::symmetric_difference_with(const Set& other) {
+    combine_with(other, Algebra::SymmetricDifference);
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::reserve_nodes(std::vector<Node*>& spare, size_t count, size_t capacity) {
+    try {
+        spare.reserve(capacity);
+        while (spare.size() != count) {
+            spare.push_back(make_node());
+        }
+    } catch (...) {
+        for (Node* v : spare) {
+            free_node(v);
+        }
+        spare.clear();
+        throw;
+    }
+}
+
+template <typename ValueType, typename Allocator>
+size_t NSet::Set<ValueType, Allocator>::height(Node* v) {
+    size_t h = 0;
+    while (v->sons_number != 1) {
+        v = v->sons[0];
+        ++h;
+    }
+    return h;
+}
+
+template <typename ValueType, typename Allocator>
+typename NSet::Set<ValueType, Allocator>::Node*
+NSet::Set<ValueType, Allocator>::join_trees(Node* left, size_t left_height, Node* right, size_t right_height,
+                                            size_t& joined_height, std::vector<Node*>& spare) {
+    if (left_height == right_height) {
+        Node* root = reuse_node(spare);
+        root->sons[0] = left;
+        root->sons[1] = right;
+        root->sons_number = 2;
+        left->parent = right->parent = root;
+        root->upd_key();
+        joined_height = left_height + 1;
+        return root;
+    }
+
+    // the lower tree becomes the outermost son of the node of its height plus one
+    // on the near spine of the higher tree, then splits go up as in an insert
+    Node* root;
+    Node* lower;
+    Node* v;
+    if (left_height > right_height) {
+        root = v = left;
+        lower = right;
+        for (size_t h = left_height; h != right_height + 1; --h) {
+            v = v->sons[v->sons_number - 1];
+        }
+        v->sons[v->sons_number] = right;
+    } else {
+        root = v = right;
+        lower = left;
+        for (size_t h = right_height; h != left_height + 1; --h) {
+            v = v->sons[0];
+        }
+        for (size_t i = v->sons_number; i != 0; --i) {
+            v->sons[i] = v->sons[i - 1];
+            v->keys[i] = v->keys[i - 1];
+        }
+        v->sons[0] = left;
+    }
+    ++v->sons_number;
+    lower->parent = v;
+    v->upd_key();
+
+    Node* higher = root;
+    split_parent(v, root, spare);
+    lower->upd_keys();
+    joined_height = std::max(left_height, right_height) + (root != higher ? 1 : 0);
+    return root;
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::split_tree(const ValueType& key, Node*& left, Node*& right,
+                                                 std::vector<Node*>& spare) {
+    // the subtrees hanging off the path with their heights, from the top down
+    std::vector<std::pair<Node*, size_t>> left_parts;
+    std::vector<std::pair<Node*, size_t>> right_parts;
+    size_t h = height(root_);
+    left_parts.reserve(h + 1);
+    right_parts.reserve(h + 1);
+
+    Node* v = root_;
+    while (v->sons_number != 1) {
+        size_t i = 0;
+        while (i + 1 != v->sons_number && *v->keys[i] < key) {
+            ++i;
+        }
+        Node* son = v->sons[i];
+        size_t after = v->sons_number - i - 1;
+        // two sons on one side keep v as their parent, single sons go on their own
+        if (i == 2) {
+            v->sons_number = 2;
+            v->parent = nullptr;
+            v->upd_key();
+            left_parts.emplace_back(v, h);
+        } else if (after == 2) {
+            v->sons[0] = v->sons[1];
+            v->sons[1] = v->sons[2];
+            v->sons_number = 2;
+            v->parent = nullptr;
+            v->upd_key();
+            right_parts.emplace_back(v, h);
+        } else {
+            if (i == 1) {
+                v->sons[0]->parent = nullptr;
+                left_parts.emplace_back(v->sons[0], h - 1);
+            }
+            if (after == 1) {
+                v->sons[i + 1]->parent = nullptr;
+                right_parts.emplace_back(v->sons[i + 1], h - 1);
+            }
+            spare.push_back(v);
+        }
+        son->parent = nullptr;
+        v = son;
+        --h;
+    }
+    if (*v->keys[0] < key) {
+        left_parts.emplace_back(v, 0);
+    } else {
+        right_parts.emplace_back(v, 0);
+    }
+
+    // joining from the bottom up keeps the total work logarithmic
+    size_t left_height = 0;
+    left = nullptr;
+    for (size_t i = left_parts.size(); i-- > 0;) {
+        if (left == nullptr) {
+            left = left_parts[i].first;
+            left_height = left_parts[i].second;
+        } else {
+            left = join_trees(left_parts[i].first, left_parts[i].second, left, left_height, left_height, spare);
+        }
+    }
+    size_t right_height = 0;
+    right = nullptr;
+    for (size_t i = right_parts.size(); i-- > 0;) {
+        if (right == nullptr) {
+            right = right_parts[i].first;
+            right_height = right_parts[i].second;
+        } else {
+            right = join_trees(right, right_height, right_parts[i].first, right_parts[i].second, right_height, spare);
+        }
+    }
+}
+
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator> NSet::Set<ValueType, Allocator>::split(const ValueType& key) {
+    // the parts trade list cells and tree nodes, so they share the allocator
+    Set right(get_allocator());
+    if (root_ == nullptr) {
+        return right;
+    }
+    set_iterator pos = position_next_to(lower_bound(key, root_), key);
+    if (pos == elements_.end()) {
+        return right;
+    }
+    if (pos == elements_.begin()) {
+        swap(right);
+        return right;
+    }
+
+    // every side is joined back from at most h + 1 pieces, which takes less than 3 (h + 1) nodes,
+    // the nodes left off the path come back to spare
+    size_t left_size = rank(key);
+    size_t h = height(root_);
+    std::vector<Node*> spare;
+    reserve_nodes(spare, 6 * (h + 1), 7 * (h + 1));
+    Node* left_root;
+    Node* right_root;
+    try {
+        split_tree(key, left_root, right_root, spare);
+    } catch (...) {
+        for (Node* v : spare) {
+            free_node(v);
+        }
+        throw;
+    }
+
+    // splicing a range counts it, so the shorter part is the one that moves
+    if (2 * left_size <= size_) {
+        right.elements_.splice(right.elements_.end(), elements_, elements_.begin(), pos);
+        elements_.swap(right.elements_);
+    } else {
+        right.elements_.splice(right.elements_.end(), elements_, pos, elements_.end());
+    }
+    right.root_ = right_root;
+    right.size_ = size_ - left_size;
+    root_ = left_root;
+    size_ = left_size;
+    finger_ = nullptr;
+    for (Node* v : spare) {
+        free_node(v);
+    }
+    return right;
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::append(Set& other) {
+    if (other.root_ == nullptr) {
+        return;
+    }
+    if (root_ == nullptr) {
+        swap(other);
+        return;
+    }
+    size_t left_height = height(root_);
+    size_t right_height = height(other.root_);
+    std::vector<Node*> spare;
+    size_t needed = std::max(left_height, right_height) + 1;
+    reserve_nodes(spare, needed, needed);
+
+    elements_.splice(elements_.end(), other.elements_);
+    size_t joined_height;
+    root_ = join_trees(root_, left_height, other.root_, right_height, joined_height, spare);
+    size_ += other.size_;
+    other.root_ = other.finger_ = nullptr;
+    other.size_ = 0;
+    for (Node* v : spare) {
+        free_node(v);
+    }
+}
+
+template <typename ValueType, typename Allocator>
+void NSet::Set<ValueType, Allocator>::merge(Set& other) {
+    if (&other == this || other.empty()) {
+        return;
+    }
+    if (get_allocator() != other.get_allocator()) {
+        // cells can't move between allocators, the new elements are copied
+        list_type batch(other.begin(), other.end(), elements_.get_allocator());
+        splice_sorted(batch);
+        Set rest(batch.begin(), batch.end(), other.get_allocator());
+        other.swap(rest);
+        return;
+    }
+    if (empty() || elements_.back() < other.elements_.front()) {
+        append(other);
+        return;
+    }
+    if (other.elements_.back() < elements_.front()) {
+        other.append(*this);
+        swap(other);
+        return;
+    }
+
+    try {
+        splice_sorted(other.elements_);
+    } catch (...) {
+        other.rebuild_tree();
+        throw;
+    }
+    other.rebuild_tree();
+}
+
+template <typename ValueType, typename Allocator>
+NSet::Set<ValueType, Allocator>::~Set() {
     elements_.clear();
     size_ = 0;
+    // the arena may outlive the set (allocator copies, split), so the nodes go back to it
     if (root_ != nullptr) {
         dfs(root_);
     }
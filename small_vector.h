@@ -0,0 +1,260 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "vector.h"
+
+// Vector that keeps up to N elements inside itself and goes to the heap only past that,
+// for the many short lists; the interface is the one of Vector
+template <typename T, std::size_t N>
+class SmallVector {
+    static_assert(N > 0, "SmallVector needs room for at least one element");
+
+private:
+    std::size_t sz;
+    std::size_t cap;
+    // points to buffer while the elements fit there
+    T* data;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type buffer[N];
+
+    T* inline_data() {
+        return reinterpret_cast<T*>(buffer);
+    }
+    bool is_inline() const {
+        return data == reinterpret_cast<const T*>(buffer);
+    }
+    void release() {
+        if (!is_inline())
+            ::operator delete(data);
+    }
+    // moves the elements to heap storage of _cap > N elements
+    void reallocate(size_t _cap) {
+        T* newdata = reinterpret_cast<T*>(::operator new(_cap * sizeof(T)));
+        try {
+            relocate_elements(data, sz, newdata);
+        } catch (...) {
+            ::operator delete(newdata);
+            throw;
+        }
+        release();
+        data = newdata;
+        cap = _cap;
+    }
+    // push_back into a full vector: the new element is built first, args may refer into the vector
+    template <typename... Args>
+    void grow_and_construct(Args&&... args) {
+        size_t _cap = 2 * cap;
+        T* newdata = reinterpret_cast<T*>(::operator new(_cap * sizeof(T)));
+        try {
+            new(newdata + sz) T(std::forward<Args>(args)...);
+        } catch (...) {
+            ::operator delete(newdata);
+            throw;
+        }
+        try {
+            relocate_elements(data, sz, newdata);
+        } catch (...) {
+            newdata[sz].~T();
+            ::operator delete(newdata);
+            throw;
+        }
+        release();
+        data = newdata;
+        cap = _cap;
+        ++sz;
+    }
+    template <typename InputIterator>
+    void append_range(InputIterator first, InputIterator last, std::input_iterator_tag) {
+        for (; first != last; ++first)
+            emplace_back(*first);
+    }
+    // grows at most once, the new elements are built before the old ones move like in Vector
+    template <typename ForwardIterator>
+    void append_range(ForwardIterator first, ForwardIterator last, std::forward_iterator_tag) {
+        size_t count = std::distance(first, last);
+        if (sz + count <= cap) {
+            std::uninitialized_copy(first, last, data + sz);
+            sz += count;
+            return;
+        }
+        size_t _cap = std::max(sz + count, 2 * cap);
+        T* newdata = reinterpret_cast<T*>(::operator new(_cap * sizeof(T)));
+        try {
+            std::uninitialized_copy(first, last, newdata + sz);
+        } catch (...) {
+            ::operator delete(newdata);
+            throw;
+        }
+        try {
+            relocate_elements(data, sz, newdata);
+        } catch (...) {
+            destroy(newdata + sz, newdata + sz + count);
+            ::operator delete(newdata);
+            throw;
+        }
+        release();
+        data = newdata;
+        cap = _cap;
+        sz += count;
+    }
+    static void destroy(T* first, T* last) {
+        while (first != last)
+            (first++)->~T();
+    }
+    // takes the elements of other, which is left empty and inline
+    void steal(SmallVector<T, N>& other) {
+        if (other.is_inline()) {
+            relocate_elements(other.data, other.sz, data);
+            sz = other.sz;
+        } else {
+            data = other.data;
+            sz = other.sz;
+            cap = other.cap;
+            other.data = other.inline_data();
+            other.cap = N;
+        }
+        other.sz = 0;
+    }
+
+public:
+    typedef typename Vector<T>::Iterator Iterator;
+
+    SmallVector()
+            : sz(0)
+            , cap(N)
+            , data(inline_data()) {
+    }
+    SmallVector(size_t _sz)
+            : SmallVector() {
+        resize(_sz);
+    }
+    SmallVector(const SmallVector<T, N>& other)
+            : SmallVector() {
+        reserve(other.sz);
+        for (const T& el : other)
+            push_back(el);
+    }
+    SmallVector(SmallVector<T, N>&& other) noexcept(std::is_nothrow_move_constructible<T>::value)
+            : SmallVector() {
+        steal(other);
+    }
+
+    void push_back(const T& val) {
+        emplace_back(val);
+    }
+    void push_back(T&& val) {
+        emplace_back(std::move(val));
+    }
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
+        if (sz == cap) {
+            grow_and_construct(std::forward<Args>(args)...);
+        } else {
+            new(data + sz) T(std::forward<Args>(args)...);
+            ++sz;
+        }
+    }
+    template <typename InputIterator>
+    void append(InputIterator first, InputIterator last) {
+        append_range(first, last, typename std::iterator_traits<InputIterator>::iterator_category());
+    }
+    void pop_back() {
+        (data + --sz)->~T();
+    }
+    const T& operator[] (size_t i) const {
+        return data[i];
+    }
+    T& operator[] (size_t i) {
+        return data[i];
+    }
+    void resize(size_t _sz) {
+        for (size_t i = _sz; i < sz; ++i)
+            (data + i)->~T();
+        if (cap < _sz)
+            reallocate(_sz);
+        for (std::size_t i = sz; i < _sz; ++i)
+            new(data + i) T();
+        sz = _sz;
+    }
+    void reserve(size_t _cap) {
+        if (cap < _cap)
+            reallocate(_cap);
+        // a smaller _cap cuts the vector down to it, like in Vector
+        for (std::size_t i = _cap; i < sz; ++i)
+            (data + i)->~T();
+        if (sz > _cap)
+            sz = _cap;
+    }
+    void swap(SmallVector<T, N>& other) {
+        SmallVector<T, N> tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+    SmallVector<T, N>& operator= (const SmallVector<T, N>& other) {
+        SmallVector<T, N> tmp(other);
+        swap(tmp);
+        return *this;
+    }
+    SmallVector<T, N>& operator= (SmallVector<T, N>&& other) noexcept(std::is_nothrow_move_constructible<T>::value) {
+        if (this != &other) {
+            clear();
+            steal(other);
+        }
+        return *this;
+    }
+    Iterator begin() const {
+        return Iterator(0, data);
+    }
+    Iterator end() const {
+        return Iterator(sz, data);
+    }
+    // insert, erase and assign work like in Vector
+    template <typename InputIterator>
+    Iterator insert(Iterator pos, InputIterator first, InputIterator last) {
+        size_t index = pos - begin();
+        size_t old_sz = sz;
+        append(first, last);
+        std::rotate(data + index, data + old_sz, data + sz);
+        return Iterator(index, data);
+    }
+    Iterator erase(Iterator first, Iterator last) {
+        size_t index = first - begin();
+        if (first == last)
+            return first;
+        T* end = std::move(data + (last - begin()), data + sz, data + index);
+        destroy(end, data + sz);
+        sz = end - data;
+        return Iterator(index, data);
+    }
+    template <typename InputIterator>
+    void assign(InputIterator first, InputIterator last) {
+        destroy(data, data + sz);
+        sz = 0;
+        append(first, last);
+    }
+    size_t size() const {
+        return sz;
+    }
+    size_t capacity() const {
+        return cap;
+    }
+    // unlike in Vector the capacity goes back to N, not to 0
+    void clear() {
+        T* end = data + sz;
+        T* ptr = data;
+        while (ptr != end)
+            (ptr++)->~T();
+        release();
+        data = inline_data();
+        cap = N;
+        sz = 0;
+    }
+    ~SmallVector() {
+        clear();
+    }
+};
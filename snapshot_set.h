@@ -0,0 +1,738 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#include "bplus_node.h"
+
+namespace NSet {
+    // persistent B+-tree set with O(1) snapshots
+    // a snapshot is another SnapshotSet sharing every node with this one; nodes are reference counted
+    // and hold neither parent pointers nor leaf links, so a write copies only the still shared nodes
+    // on its root-to-leaf path (and the brothers it rebalances with), everything else stays shared.
+    // Every object is single-threaded, but different versions may be used from different threads;
+    // a node is freed by the version that drops it last, so Allocator has to be thread-safe then
+    template <typename ValueType, typename Allocator = std::allocator<ValueType>,
+              size_t NodeKeys = bplus_node_keys<ValueType>() / 2>
+    class SnapshotSet {
+    private:
+        friend struct BPlusOps<SnapshotSet>;
+        typedef BPlusOps<SnapshotSet> tree_ops;
+
+        static constexpr size_t MaxHeight = 64;
+
+        struct Node : BPlusNode<ValueType, NodeKeys> {
+            // parents and versions pointing here
+            std::atomic<size_t> refs;
+
+            explicit
+            Node(bool is_leaf);
+        };
+
+        struct Son {
+            Node* node;
+            // elements under node, for nth and rank
+            size_t count;
+        };
+
+        struct Leaf : Node {
+            Leaf();
+        };
+
+        typedef BPlusInner<Node, Son, NodeKeys> Inner;
+
+        typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Leaf> leaf_allocator_type;
+        typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Inner> inner_allocator_type;
+
+        Node* root_;
+        size_t size_;
+        size_t copies_;
+        leaf_allocator_type leaf_allocator_;
+        inner_allocator_type inner_allocator_;
+
+        Leaf* new_leaf();
+        Inner* new_inner();
+        // copies the keys and shares the sons
+        Node* clone(const Node* v);
+        // destroys v without touching its sons
+        void free_node(Node* v);
+        // drops a reference, the last one frees v and drops its sons
+        void release(Node* v);
+        // makes the node in slot private to this version, copying it if another one still points to it;
+        // the parent of slot has to be private already
+        void own(Node*& slot);
+
+        static size_t total(const Node* v);
+
+        // hooks of BPlusOps; a merge takes the keys of a still shared right node by copy
+        // and drops the reference, instead of making a private copy just to take it apart
+        static Son son_of(Node* v);
+        Node* writable(Son& son);
+        void merge_leaves(Leaf* left, Son& right);
+        void merge_inners(Inner* left, ValueType& separator, Son& right);
+
+        // leaves next to the one holding key, nullptr past the ends
+        static const Node* next_leaf(const Node* root, const ValueType& key);
+        static const Node* prev_leaf(const Node* root, const ValueType& key);
+
+    public:
+        explicit
+        SnapshotSet(const Allocator& alloc = Allocator());
+
+        template <typename InputIterator>
+        SnapshotSet(InputIterator begin, InputIterator end, const Allocator& alloc = Allocator());
+        SnapshotSet(std::initializer_list<ValueType> init_list, const Allocator& alloc = Allocator());
+        // O(1), the copy shares the whole tree
+        SnapshotSet(const SnapshotSet& other);
+        SnapshotSet(SnapshotSet&& other) noexcept;
+
+        void swap(SnapshotSet& other) noexcept;
+        SnapshotSet& operator= (SnapshotSet other) noexcept;
+
+        ~SnapshotSet();
+
+        typedef SnapshotSet snapshot_type;
+
+        // a version of its own that later writes here don't change, O(1)
+        snapshot_type snapshot() const;
+
+        // how many nodes writes had to copy because another version still shared them
+        size_t copies() const;
+
+        size_t size() const;
+        bool empty() const;
+
+        class iterator {
+        private:
+            friend class SnapshotSet;
+
+            // the root the iterator walks, leaves are found from it again
+            const Node* root;
+            // nullptr at the end
+            const Node* leaf;
+            size_t index;
+
+            iterator(const Node* _root, const Node* _leaf, size_t _index)
+                : root(_root)
+                , leaf(_leaf)
+                , index(_index) {
+            }
+
+        public:
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef ValueType value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const ValueType* pointer;
+            typedef const ValueType& reference;
+
+            iterator()
+                : root(nullptr)
+                , leaf(nullptr)
+                , index(0) {
+            }
+
+            const ValueType& operator* () const {
+                return leaf->key(index);
+            }
+
+            const ValueType* operator-> () const {
+                return &**this;
+            }
+
+            // moving to the next leaf goes down from the root again, O(log n) once per leaf
+            iterator& operator++ () {
+                if (++index == leaf->keys_number) {
+                    leaf = next_leaf(root, leaf->key(index - 1));
+                    index = 0;
+                }
+                return *this;
+            }
+
+            iterator operator++ (int) {
+                iterator tmp(*this);
+                ++*this;
+                return tmp;
+            }
+
+            iterator& operator-- () {
+                if (leaf == nullptr) {
+                    leaf = root;
+                    while (!leaf->leaf) {
+                        const Inner* inner = static_cast<const Inner*>(leaf);
+                        leaf = inner->sons[inner->keys_number].node;
+                    }
+                    index = leaf->keys_number;
+                } else if (index == 0) {
+                    leaf = prev_leaf(root, leaf->key(0));
+                    index = leaf->keys_number;
+                }
+                --index;
+                return *this;
+            }
+
+            iterator operator-- (int) {
+                iterator tmp(*this);
+                --*this;
+                return tmp;
+            }
+
+            bool operator== (const iterator& other) const {
+                return leaf == other.leaf && index == other.index;
+            }
+
+            bool operator!= (const iterator& other) const {
+                return !(*this == other);
+            }
+        };
+
+    private:
+        // ValueType x is not in the set, returns where it went
+        iterator insert_new(ValueType&& x);
+
+    public:
+        // writes invalidate iterators of this version taken before them
+        void insert(const ValueType& x);
+        void insert(ValueType&& x);
+        // builds the element first, nothing is copied if an equal one is there
+        template <typename... Args>
+        std::pair<iterator, bool> emplace(Args&&... args);
+        void erase(const ValueType& x);
+
+        iterator begin() const;
+        iterator end() const;
+
+        iterator find(const ValueType& key) const;
+        iterator lower_bound(const ValueType& key) const;
+        // k-th smallest element (from 0), end() if there are not enough elements
+        iterator nth(size_t k) const;
+        // number of elements less than key
+        size_t rank(const ValueType& key) const;
+    };
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::Node::Node(bool is_leaf)
+    : BPlusNode<ValueType, NodeKeys>(is_leaf)
+    , refs(1) {
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::Leaf::Leaf()
+    : Node(true) {
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::Leaf*
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::new_leaf() {
+    Leaf* v = std::allocator_traits<leaf_allocator_type>::allocate(leaf_allocator_, 1);
+    std::allocator_traits<leaf_allocator_type>::construct(leaf_allocator_, v);
+    return v;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::Inner*
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::new_inner() {
+    Inner* v = std::allocator_traits<inner_allocator_type>::allocate(inner_allocator_, 1);
+    std::allocator_traits<inner_allocator_type>::construct(inner_allocator_, v);
+    return v;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::Node*
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::clone(const Node* v) {
+    Node* copy = v->leaf ? static_cast<Node*>(new_leaf()) : static_cast<Node*>(new_inner());
+    try {
+        copy->copy_keys(v);
+    } catch (...) {
+        free_node(copy);
+        throw;
+    }
+    if (!v->leaf) {
+        const Inner* inner = static_cast<const Inner*>(v);
+        Inner* inner_copy = static_cast<Inner*>(copy);
+        for (size_t j = 0; j != inner->keys_number + 1; ++j) {
+            inner_copy->sons[j] = inner->sons[j];
+            inner->sons[j].node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return copy;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+void NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::free_node(Node* v) {
+    if (v->leaf) {
+        Leaf* leaf = static_cast<Leaf*>(v);
+        std::allocator_traits<leaf_allocator_type>::destroy(leaf_allocator_, leaf);
+        std::allocator_traits<leaf_allocator_type>::deallocate(leaf_allocator_, leaf, 1);
+    } else {
+        Inner* inner = static_cast<Inner*>(v);
+        std::allocator_traits<inner_allocator_type>::destroy(inner_allocator_, inner);
+        std::allocator_traits<inner_allocator_type>::deallocate(inner_allocator_, inner, 1);
+    }
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+void NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::release(Node* v) {
+    // acq_rel: whoever frees the node sees every read the other versions made of it
+    if (v->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (!v->leaf) {
+        Inner* inner = static_cast<Inner*>(v);
+        for (size_t j = 0; j != inner->keys_number + 1; ++j) {
+            release(inner->sons[j].node);
+        }
+    }
+    free_node(v);
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+void NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::own(Node*& slot) {
+    if (slot->refs.load(std::memory_order_acquire) == 1) {
+        return;
+    }
+    Node* copy = clone(slot);
+    // another version may drop its reference meanwhile, so the old node may go right here
+    release(slot);
+    slot = copy;
+    ++copies_;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+size_t NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::total(const Node* v) {
+    if (v->leaf) {
+        return v->keys_number;
+    }
+    const Inner* inner = static_cast<const Inner*>(v);
+    size_t sum = 0;
+    for (size_t j = 0; j != inner->keys_number + 1; ++j) {
+        sum += inner->sons[j].count;
+    }
+    return sum;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::Son
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::son_of(Node* v) {
+    return Son{v, total(v)};
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::Node*
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::writable(Son& son) {
+    own(son.node);
+    return son.node;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+void NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::merge_leaves(Leaf* left, Son& right) {
+    Node* v = right.node;
+    if (v->refs.load(std::memory_order_acquire) == 1) {
+        v->move_keys(0, left);
+        free_node(v);
+        return;
+    }
+    left->copy_keys(v);
+    release(v);
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+void NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::merge_inners(Inner* left, ValueType& separator, Son& right) {
+    Inner* inner = static_cast<Inner*>(right.node);
+    if (inner->refs.load(std::memory_order_acquire) == 1) {
+        // the sons keep the references inner had
+        tree_ops::absorb_inner(left, separator, inner);
+        free_node(inner);
+        return;
+    }
+    // the copies go first, a throw leaves left as it was
+    size_t shift = left->keys_number + 1;
+    left->copy_keys(inner);
+    left->emplace_key(shift - 1, std::move(separator));
+    for (size_t j = 0; j != inner->keys_number + 1; ++j) {
+        left->sons[shift + j] = inner->sons[j];
+        inner->sons[j].node->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    release(inner);
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::SnapshotSet(const Allocator& alloc)
+    : root_(nullptr)
+    , size_(0)
+    , copies_(0)
+    , leaf_allocator_(alloc)
+    , inner_allocator_(alloc) {
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+template <typename InputIterator>
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::SnapshotSet(InputIterator begin, InputIterator end,
+                                                               const Allocator& alloc)
+    : SnapshotSet(alloc) {
+    // the delegated constructor is done, so the destructor cleans up if an insert throws
+    while (begin != end) {
+        insert(*(begin++));
+    }
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::SnapshotSet(std::initializer_list<ValueType> init_list,
+                                                               const Allocator& alloc)
+    : SnapshotSet(init_list.begin(), init_list.end(), alloc) {
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::SnapshotSet(const SnapshotSet& other)
+    : root_(other.root_)
+    , size_(other.size_)
+    , copies_(0)
+    , leaf_allocator_(other.leaf_allocator_)
+    , inner_allocator_(other.inner_allocator_) {
+    if (root_ != nullptr) {
+        root_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::SnapshotSet(SnapshotSet&& other) noexcept
+    : root_(other.root_)
+    , size_(other.size_)
+    , copies_(other.copies_)
+    , leaf_allocator_(other.leaf_allocator_)
+    , inner_allocator_(other.inner_allocator_) {
+    other.root_ = nullptr;
+    other.size_ = 0;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+void NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::swap(SnapshotSet& other) noexcept {
+    std::swap(root_, other.root_);
+    std::swap(size_, other.size_);
+    std::swap(copies_, other.copies_);
+    std::swap(leaf_allocator_, other.leaf_allocator_);
+    std::swap(inner_allocator_, other.inner_allocator_);
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>&
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::operator= (SnapshotSet other) noexcept {
+    swap(other);
+    return *this;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::~SnapshotSet() {
+    if (root_ != nullptr) {
+        release(root_);
+    }
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::snapshot_type
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::snapshot() const {
+    return *this;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+size_t NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::copies() const {
+    return copies_;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+size_t NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::size() const {
+    return size_;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+bool NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::empty() const {
+    return size_ == 0;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::iterator
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::insert_new(ValueType&& x) {
+    if (root_ == nullptr) {
+        Leaf* leaf = new_leaf();
+        try {
+            leaf->emplace_key(0, std::move(x));
+        } catch (...) {
+            free_node(leaf);
+            throw;
+        }
+        root_ = leaf;
+        ++size_;
+        return iterator(root_, leaf, 0);
+    }
+
+    // the path is made private top-down, a throw on the way leaves a valid tree
+    Inner* path[MaxHeight];
+    size_t path_index[MaxHeight];
+    size_t depth = 0;
+    own(root_);
+    Node* v = root_;
+    while (!v->leaf) {
+        Inner* inner = static_cast<Inner*>(v);
+        path[depth] = inner;
+        path_index[depth] = inner->upper_index(x);
+        own(inner->sons[path_index[depth]].node);
+        v = inner->sons[path_index[depth]].node;
+        ++depth;
+    }
+
+    Leaf* leaf = static_cast<Leaf*>(v);
+    size_t i = leaf->lower_index(x);
+    if (leaf->keys_number != NodeKeys) {
+        leaf->emplace_key(i, std::move(x));
+        ++size_;
+        for (size_t d = 0; d != depth; ++d) {
+            ++path[d]->sons[path_index[d]].count;
+        }
+        return iterator(root_, leaf, i);
+    }
+
+    ValueType up_key(leaf->key(NodeKeys / 2));
+    Leaf* split_leaf = new_leaf();
+    std::pair<Leaf*, size_t> place = tree_ops::split_leaf(leaf, split_leaf, i, std::move(x));
+    ++size_;
+    // the parents above the one that took the split without splitting itself only grew by one
+    size_t above = tree_ops::push_up(*this, path, path_index, depth, up_key, son_of(split_leaf), root_);
+    for (size_t d = 0; d != above; ++d) {
+        ++path[d]->sons[path_index[d]].count;
+    }
+    return iterator(root_, place.first, place.second);
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+void NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::insert(const ValueType& x) {
+    // an element that is there already must not copy the path
+    if (find(x) != end()) {
+        return;
+    }
+    insert_new(ValueType(x));
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+void NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::insert(ValueType&& x) {
+    if (find(x) != end()) {
+        return;
+    }
+    insert_new(std::move(x));
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+template <typename... Args>
+std::pair<typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::iterator, bool>
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::emplace(Args&&... args) {
+    ValueType x(std::forward<Args>(args)...);
+    iterator it = find(x);
+    if (it != end()) {
+        return std::make_pair(it, false);
+    }
+    return std::make_pair(insert_new(std::move(x)), true);
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+void NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::erase(const ValueType& key) {
+    // a missing element must not copy the path
+    if (find(key) == end()) {
+        return;
+    }
+
+    Inner* path[MaxHeight];
+    size_t path_index[MaxHeight];
+    size_t depth = 0;
+    own(root_);
+    Node* v = root_;
+    while (!v->leaf) {
+        Inner* inner = static_cast<Inner*>(v);
+        if (inner->keys_number == 0) {
+            // only an erase that threw above the leaves leaves an inner node without keys,
+            // it gets brothers again before any of its sons may need one
+            if (depth == 0) {
+                root_ = inner->sons[0].node;
+                free_node(inner);
+            } else {
+                tree_ops::rebalance_inner(*this, inner, path[depth - 1], path_index[depth - 1]);
+                depth = 0;
+            }
+            own(root_);
+            v = root_;
+            continue;
+        }
+        path[depth] = inner;
+        path_index[depth] = inner->upper_index(key);
+        own(inner->sons[path_index[depth]].node);
+        v = inner->sons[path_index[depth]].node;
+        ++depth;
+    }
+
+    Leaf* leaf = static_cast<Leaf*>(v);
+    size_t i = leaf->lower_index(key);
+    // kept until the leaf is refilled: if copying a brother throws the key goes back,
+    // so no leaf the iterators step through is ever emptied
+    ValueType erased(std::move(leaf->key(i)));
+    leaf->remove_key(i);
+    --size_;
+    for (size_t d = 0; d != depth; ++d) {
+        --path[d]->sons[path_index[d]].count;
+    }
+
+    if (depth == 0) {
+        if (leaf->keys_number == 0) {
+            free_node(leaf);
+            root_ = nullptr;
+        }
+        return;
+    }
+    if (leaf->keys_number >= tree_ops::MinLeafKeys) {
+        return;
+    }
+
+    try {
+        tree_ops::rebalance_leaf(*this, leaf, path[depth - 1], path_index[depth - 1]);
+    } catch (...) {
+        leaf->emplace_key(i, std::move(erased));
+        ++size_;
+        for (size_t d = 0; d != depth; ++d) {
+            ++path[d]->sons[path_index[d]].count;
+        }
+        throw;
+    }
+    tree_ops::rebalance_inners(*this, path, path_index, depth);
+    Inner* top = static_cast<Inner*>(root_);
+    if (top->keys_number == 0) {
+        // the only son moves up with the reference top had
+        root_ = top->sons[0].node;
+        free_node(top);
+    }
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+const typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::Node*
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::next_leaf(const Node* root, const ValueType& key) {
+    // the deepest right brother on the path to key holds the next leaf
+    const Node* right = nullptr;
+    const Node* v = root;
+    while (!v->leaf) {
+        const Inner* inner = static_cast<const Inner*>(v);
+        size_t j = inner->upper_index(key);
+        if (j != inner->keys_number) {
+            right = inner->sons[j + 1].node;
+        }
+        v = inner->sons[j].node;
+    }
+    if (right == nullptr) {
+        return nullptr;
+    }
+    while (!right->leaf) {
+        right = static_cast<const Inner*>(right)->sons[0].node;
+    }
+    return right;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+const typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::Node*
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::prev_leaf(const Node* root, const ValueType& key) {
+    const Node* left = nullptr;
+    const Node* v = root;
+    while (!v->leaf) {
+        const Inner* inner = static_cast<const Inner*>(v);
+        size_t j = inner->upper_index(key);
+        if (j != 0) {
+            left = inner->sons[j - 1].node;
+        }
+        v = inner->sons[j].node;
+    }
+    while (!left->leaf) {
+        const Inner* inner = static_cast<const Inner*>(left);
+        left = inner->sons[inner->keys_number].node;
+    }
+    return left;
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::iterator
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::begin() const {
+    if (root_ == nullptr) {
+        return end();
+    }
+    const Node* v = root_;
+    while (!v->leaf) {
+        v = static_cast<const Inner*>(v)->sons[0].node;
+    }
+    return iterator(root_, v, 0);
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::iterator
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::end() const {
+    return iterator(root_, nullptr, 0);
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::iterator
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::find(const ValueType& key) const {
+    iterator it = lower_bound(key);
+    if (it != end() && !(key < *it)) {
+        return it;
+    }
+    return end();
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::iterator
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::lower_bound(const ValueType& key) const {
+    if (root_ == nullptr) {
+        return end();
+    }
+    const Node* v = root_;
+    while (!v->leaf) {
+        const Inner* inner = static_cast<const Inner*>(v);
+        v = inner->sons[inner->upper_index(key)].node;
+    }
+    size_t i = v->lower_index(key);
+    if (i == v->keys_number) {
+        return iterator(root_, next_leaf(root_, v->key(i - 1)), 0);
+    }
+    return iterator(root_, v, i);
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+typename NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::iterator
+NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::nth(size_t k) const {
+    if (k >= size_) {
+        return end();
+    }
+    const Node* v = root_;
+    while (!v->leaf) {
+        const Inner* inner = static_cast<const Inner*>(v);
+        size_t j = 0;
+        while (k >= inner->sons[j].count) {
+            k -= inner->sons[j++].count;
+        }
+        v = inner->sons[j].node;
+    }
+    return iterator(root_, v, k);
+}
+
+template <typename ValueType, typename Allocator, size_t NodeKeys>
+size_t NSet::SnapshotSet<ValueType, Allocator, NodeKeys>::rank(const ValueType& key) const {
+    if (root_ == nullptr) {
+        return 0;
+    }
+    size_t less = 0;
+    const Node* v = root_;
+    while (!v->leaf) {
+        const Inner* inner = static_cast<const Inner*>(v);
+        size_t j = inner->upper_index(key);
+        for (size_t i = 0; i != j; ++i) {
+            less += inner->sons[i].count;
+        }
+        v = inner->sons[j].node;
+    }
+    return less + v->lower_index(key);
+}
@@ -1,5 +1,41 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <new>
+#include <type_traits>
+#include <utility>
+
+// types whose objects can be moved to another address with memcpy, leaving nothing to destroy behind;
+// specialize it for types that hold no pointers into themselves
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {
+};
+
+// moves count elements from from to the raw memory to, the sources are destroyed,
+// if a copy throws nothing is changed
+template <typename T>
+void relocate_elements(T* from, size_t count, T* to) {
+    if (is_trivially_relocatable<T>::value) {
+        if (count != 0)
+            std::memcpy(static_cast<void*>(to), static_cast<const void*>(from), count * sizeof(T));
+        return;
+    }
+    size_t done = 0;
+    try {
+        for (; done != count; ++done)
+            new(to + done) T(std::move_if_noexcept(from[done]));
+    } catch (...) {
+        while (done != 0)
+            to[--done].~T();
+        throw;
+    }
+    for (size_t i = 0; i != count; ++i)
+        from[i].~T();
+}
 
 template <typename T>
 class Vector {
@@ -8,73 +44,135 @@ private:
     std::size_t cap;
     T* data;
 
+    static T* allocate(size_t _cap) {
+        return _cap == 0 ? nullptr : reinterpret_cast<T*>(::operator new(_cap * sizeof(T)));
+    }
+    // moves the elements to new storage of _cap >= sz elements
+    void reallocate(size_t _cap) {
+        T* newdata = allocate(_cap);
+        try {
+            relocate_elements(data, sz, newdata);
+        } catch (...) {
+            ::operator delete(newdata);
+            throw;
+        }
+        ::operator delete(data);
+        data = newdata;
+        cap = _cap;
+    }
+    // push_back into a full vector: the new element is built first, args may refer into the vector
+    template <typename... Args>
+    void grow_and_construct(Args&&... args) {
+        size_t _cap = (cap == 0 ? 1 : 2 * cap);
+        T* newdata = allocate(_cap);
+        try {
+            new(newdata + sz) T(std::forward<Args>(args)...);
+        } catch (...) {
+            ::operator delete(newdata);
+            throw;
+        }
+        try {
+            relocate_elements(data, sz, newdata);
+        } catch (...) {
+            newdata[sz].~T();
+            ::operator delete(newdata);
+            throw;
+        }
+        ::operator delete(data);
+        data = newdata;
+        cap = _cap;
+        ++sz;
+    }
+    template <typename InputIterator>
+    void append_range(InputIterator first, InputIterator last, std::input_iterator_tag) {
+        for (; first != last; ++first)
+            emplace_back(*first);
+    }
+    // the size is known, so the storage grows at most once and the elements are copied straight into it;
+    // like in grow_and_construct the new elements are built before the old ones move, the range may lie in the vector
+    template <typename ForwardIterator>
+    void append_range(ForwardIterator first, ForwardIterator last, std::forward_iterator_tag) {
+        size_t count = std::distance(first, last);
+        if (sz + count <= cap) {
+            std::uninitialized_copy(first, last, data + sz);
+            sz += count;
+            return;
+        }
+        size_t _cap = std::max(sz + count, 2 * cap);
+        T* newdata = allocate(_cap);
+        try {
+            std::uninitialized_copy(first, last, newdata + sz);
+        } catch (...) {
+            ::operator delete(newdata);
+            throw;
+        }
+        try {
+            relocate_elements(data, sz, newdata);
+        } catch (...) {
+            destroy(newdata + sz, newdata + sz + count);
+            ::operator delete(newdata);
+            throw;
+        }
+        ::operator delete(data);
+        data = newdata;
+        cap = _cap;
+        sz += count;
+    }
+    static void destroy(T* first, T* last) {
+        while (first != last)
+            (first++)->~T();
+    }
+
 public:
     Vector()
             : sz(0)
-            , cap(0) {
+            , cap(0)
+            , data(nullptr) {
     }
     Vector(size_t _sz)
             : sz(_sz)
             , cap(_sz)
-            , data(reinterpret_cast<T*>(::operator new(_sz * sizeof(T)))) {
-        T* end = data + sz, ptr = data;
+            , data(allocate(_sz)) {
+        T* end = data + sz;
+        T* ptr = data;
         while (ptr != end)
             new(ptr++) T();
     }
     Vector(const Vector<T>& other)
             : sz(0)
             , cap(other.sz)
-            , data(reinterpret_cast<T*>(::operator new(other.sz * sizeof(T)))) {
+            , data(allocate(other.sz)) {
         for (const T& el : other)
             push_back(el);
     }
+    Vector(Vector<T>&& other) noexcept
+            : sz(other.sz)
+            , cap(other.cap)
+            , data(other.data) {
+        other.sz = other.cap = 0;
+        other.data = nullptr;
+    }
 
     void push_back(const T& val) {
-        if (sz == cap) {
-            size_t _cap = cap;
-            cap = (cap == 0 ? 1 : 2 * cap);
-            T* newdata = reinterpret_cast<T*>(::operator new(cap * sizeof(T)));
-            new(newdata + sz) T(val);
-            T* end = newdata + sz;
-            T* ptr = newdata;
-            T* ptr1 = data;
-            while (ptr != end)
-                new(ptr++) T(*(ptr1++));
-            if (_cap != 0) {
-                end = data + sz, ptr = data;
-                while (ptr != end)
-                    (ptr++)->~T();
-                ::operator delete(data);
-            }
-            ++sz;
-            data = newdata;
-        } else {
-            new(data + sz++) T(val);
-        }
+        emplace_back(val);
     }
     void push_back(T&& val) {
+        emplace_back(std::move(val));
+    }
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
         if (sz == cap) {
-            size_t _cap = cap;
-            cap = (cap == 0 ? 1 : 2 * cap);
-            T* newdata = reinterpret_cast<T*>(::operator new(cap * sizeof(T)));
-            new(newdata + sz) T(std::move(val));
-            T* end = newdata + sz;
-            T* ptr = newdata;
-            T* ptr1 = data;
-            while (ptr != end)
-                new(ptr++) T(*(ptr1++));
-            if (_cap != 0) {
-                end = data + sz, ptr = data;
-                while (ptr != end)
-                    (ptr++)->~T();
-                ::operator delete(data);
-            }
-            ++sz;
-            data = newdata;
+            grow_and_construct(std::forward<Args>(args)...);
         } else {
-            new(data + sz++) T(std::move(val));
+            new(data + sz) T(std::forward<Args>(args)...);
+            ++sz;
         }
     }
+    // adds the elements of [first, last) at the end
+    template <typename InputIterator>
+    void append(InputIterator first, InputIterator last) {
+        append_range(first, last, typename std::iterator_traits<InputIterator>::iterator_category());
+    }
     void pop_back() {
         (data + --sz)->~T();
     }
@@ -88,22 +186,10 @@ public:
         for (size_t i = _sz; i < sz; ++i)
             (data + i)->~T();
         if (cap < _sz) {
-            T* newdata = reinterpret_cast<T*>(::operator new(_sz * sizeof(T)));
-            T* end = newdata + std::min(sz, _sz);
-            T* ptr = newdata;
-            T* ptr1 = data;
-            while (ptr != end)
-                new(ptr++) T(*(ptr1++));
+            reallocate(_sz);
             for (std::size_t i = sz; i != _sz; ++i)
-                new(newdata + i) T();
-            if (cap != 0) {
-                end = data + sz, ptr = data;
-                while (ptr != end)
-                    (ptr++)->~T();
-                ::operator delete(data);
-            }
-            sz = cap = _sz;
-            data = newdata;
+                new(data + i) T();
+            sz = _sz;
         } else if (sz < _sz) {
             for (std::size_t i = sz; i != _sz; ++i)
                 new(data + i) T();
@@ -112,26 +198,13 @@ public:
         sz = _sz;
     }
     void reserve(size_t _cap) {
-        if (cap < _cap) {
-            T* newdata = reinterpret_cast<T*>(::operator new(_cap * sizeof(T)));
-            T* end = newdata + sz;
-            T* ptr = newdata;
-            T* ptr1 = data;
-            while (ptr != end)
-                new(ptr++) T(*(ptr1++));
-            if (cap != 0) {
-                end = data + sz, ptr = data;
-                while (ptr != end)
-                    (ptr++)->~T();
-                ::operator delete(data);
-            }
-            data = newdata;
-            cap = _cap;
-        }
+        if (cap < _cap)
+            reallocate(_cap);
+        // a smaller _cap cuts the vector down to it
         for (std::size_t i = _cap; i < sz; ++i)
             (data + i)->~T();
-        if (sz > cap)
-            sz = cap;
+        if (sz > _cap)
+            sz = _cap;
     }
     void swap(Vector<T>& other) {
         std::swap(sz, other.sz);
@@ -143,12 +216,23 @@ public:
         swap(tmp);
         return *this;
     }
+    Vector<T>& operator= (Vector<T>&& other) noexcept {
+        Vector<T> tmp(std::move(other));
+        swap(tmp);
+        return *this;
+    }
     class Iterator {
     private:
         std::size_t i;
         T* ptr;
 
     public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef T* pointer;
+        typedef T& reference;
+
         Iterator(std::size_t _i, T* _ptr)
                 : i(_i)
                 , ptr(_ptr) {
@@ -159,17 +243,68 @@ public:
         T& operator* () {
             return ptr[i];
         }
+        T* operator-> () const {
+            return ptr + i;
+        }
+        T& operator[] (std::ptrdiff_t n) const {
+            return ptr[i + n];
+        }
         Iterator& operator++ () {
             ++i;
             return *this;
         }
-        Iterator operator-- () {
+        Iterator operator++ (int) {
+            Iterator tmp(*this);
+            ++i;
+            return tmp;
+        }
+        Iterator& operator-- () {
+            --i;
+            return *this;
+        }
+        Iterator operator-- (int) {
+            Iterator tmp(*this);
             --i;
+            return tmp;
+        }
+        Iterator& operator+= (std::ptrdiff_t n) {
+            i += n;
             return *this;
         }
+        Iterator& operator-= (std::ptrdiff_t n) {
+            i -= n;
+            return *this;
+        }
+        Iterator operator+ (std::ptrdiff_t n) const {
+            return Iterator(i + n, ptr);
+        }
+        Iterator operator- (std::ptrdiff_t n) const {
+            return Iterator(i - n, ptr);
+        }
+        std::ptrdiff_t operator- (const Iterator& other) const {
+            return i - other.i;
+        }
+        bool operator== (const Iterator& other) const {
+            return ptr == other.ptr && i == other.i;
+        }
         bool operator!= (const Iterator& other) const {
             return !(ptr == other.ptr && i == other.i);
         }
+        bool operator< (const Iterator& other) const {
+            return i < other.i;
+        }
+        bool operator> (const Iterator& other) const {
+            return i > other.i;
+        }
+        bool operator<= (const Iterator& other) const {
+            return i <= other.i;
+        }
+        bool operator>= (const Iterator& other) const {
+            return i >= other.i;
+        }
+        friend Iterator operator+ (std::ptrdiff_t n, const Iterator& it) {
+            return it + n;
+        }
     };
     Iterator begin() const {
         return Iterator(0, data);
@@ -177,6 +312,35 @@ public:
     Iterator end() const {
         return Iterator(sz, data);
     }
+    // inserts the elements of [first, last) before pos and returns the iterator to the first of them:
+    // they are built once at the end and rotated into place, so the range may lie in the vector
+    template <typename InputIterator>
+    Iterator insert(Iterator pos, InputIterator first, InputIterator last) {
+        size_t index = pos - begin();
+        size_t old_sz = sz;
+        append(first, last);
+        std::rotate(data + index, data + old_sz, data + sz);
+        return Iterator(index, data);
+    }
+    // removes [first, last), returns the iterator to the element that followed them
+    Iterator erase(Iterator first, Iterator last) {
+        size_t index = first - begin();
+        // std::move onto the same range would self-move-assign the elements after it
+        if (first == last)
+            return first;
+        T* end = std::move(data + (last - begin()), data + sz, data + index);
+        destroy(end, data + sz);
+        sz = end - data;
+        return Iterator(index, data);
+    }
+    // replaces the elements with the ones of [first, last), which must not lie in the vector;
+    // the storage is kept if the range fits
+    template <typename InputIterator>
+    void assign(InputIterator first, InputIterator last) {
+        destroy(data, data + sz);
+        sz = 0;
+        append(first, last);
+    }
     size_t size() const {
         return sz;
     }
@@ -184,13 +348,12 @@ public:
         return cap;
     }
     void clear() {
-        if (cap != 0) {
-            T* end = data + sz;
-            T* ptr = data;
-            while (ptr != end)
-                (ptr++)->~T();
-            ::operator delete(data);
-        }
+        T* end = data + sz;
+        T* ptr = data;
+        while (ptr != end)
+            (ptr++)->~T();
+        ::operator delete(data);
+        data = nullptr;
         cap = 0;
         sz = 0;
     }
@@ -199,3 +362,8 @@ public:
     }
 };
 
+// a Vector only points at its elements, so it can be moved with memcpy
+template <typename T>
+struct is_trivially_relocatable<Vector<T>> : std::true_type {
+};
+